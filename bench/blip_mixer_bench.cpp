@@ -0,0 +1,111 @@
+// Measures Blip_Mixer mixing 16 buffers to stereo in one pass, against reading
+// a single buffer and against reading all 16 separately and mixing them.
+
+#include "nes_apu/Multi_Buffer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+typedef std::chrono::steady_clock bench_clock;
+
+static int const sample_rate = 48000;
+static long const clock_rate = 1789773;
+static int const frame_length = clock_rate / 60;
+static int const frames = 600;
+static int const buf_count = 16;
+
+// Adds a frame of square waves with a different period to each buffer
+static void fill_frames( std::vector<Blip_Buffer>& bufs, Blip_Synth_Norm& synth, std::vector<int>& amps )
+{
+	for ( int b = 0; b < (int) bufs.size(); b++ )
+	{
+		int const period = 40 + b * 37;
+		for ( blip_time_t t = b; t < frame_length; t += period )
+		{
+			int new_amp = (amps [b] > 0) ? -8 : 8;
+			synth.offset( t, new_amp - amps [b], &bufs [b] );
+			amps [b] = new_amp;
+		}
+		bufs [b].end_frame( frame_length );
+	}
+}
+
+// Returns nanoseconds per output sample pair, for all frames
+template<class F>
+static double time_frames( int count, F read )
+{
+	std::vector<Blip_Buffer> bufs( count );
+	for ( Blip_Buffer& buf : bufs )
+	{
+		if ( buf.set_sample_rate( sample_rate ) )
+			return 0;
+		buf.clock_rate( clock_rate );
+	}
+	Blip_Synth_Norm synth;
+	synth.volume( 0.1 );
+	std::vector<int> amps( count );
+
+	bench_clock::duration elapsed = bench_clock::duration::zero();
+	long total = 0;
+	for ( int n = 0; n < frames; n++ )
+	{
+		fill_frames( bufs, synth, amps );
+		int avail = bufs [0].samples_avail();
+
+		bench_clock::time_point start = bench_clock::now();
+		read( bufs, avail );
+		elapsed += bench_clock::now() - start;
+		total += avail;
+	}
+	return std::chrono::duration<double, std::nano>( elapsed ).count() / total;
+}
+
+static std::vector<blip_sample_t> out( sample_rate * 2 );
+static std::vector<blip_sample_t> temp( sample_rate );
+static std::vector<int> mix( sample_rate * 2 );
+
+static void make_inputs( std::vector<Blip_Buffer>& bufs, Blip_Mixer::input_t in [] )
+{
+	for ( int b = 0; b < (int) bufs.size(); b++ )
+	{
+		in [b].buf = &bufs [b];
+		in [b].gain [0] = Blip_Mixer::gain_unit * (b + 1) / buf_count;
+		in [b].gain [1] = Blip_Mixer::gain_unit - in [b].gain [0];
+	}
+}
+
+int main()
+{
+	double single_ns = time_frames( 1, []( std::vector<Blip_Buffer>& bufs, int count ) {
+		bufs [0].read_samples( out.data(), count );
+	} );
+
+	double separate_ns = time_frames( buf_count, []( std::vector<Blip_Buffer>& bufs, int count ) {
+		Blip_Mixer::input_t in [buf_count];
+		make_inputs( bufs, in );
+		std::fill( mix.begin(), mix.begin() + count * 2, 0 );
+		for ( int b = 0; b < buf_count; b++ )
+		{
+			bufs [b].read_samples( temp.data(), count );
+			for ( int i = 0; i < count; i++ )
+			{
+				mix [i * 2    ] += temp [i] * in [b].gain [0];
+				mix [i * 2 + 1] += temp [i] * in [b].gain [1];
+			}
+		}
+		Blip_Mixer::raw_to_samples( mix.data(), out.data(), count * 2 );
+	} );
+
+	double mixer_ns = time_frames( buf_count, []( std::vector<Blip_Buffer>& bufs, int count ) {
+		Blip_Mixer::input_t in [buf_count];
+		make_inputs( bufs, in );
+		Blip_Mixer::read_pairs( in, buf_count, out.data(), count );
+	} );
+
+	printf( "1 buffer read_samples       %7.3f ns/pair\n", single_ns );
+	printf( "%d buffers read separately  %7.3f ns/pair (%.1fx single)\n", buf_count, separate_ns, separate_ns / single_ns );
+	printf( "%d buffers Blip_Mixer       %7.3f ns/pair (%.1fx single)\n", buf_count, mixer_ns, mixer_ns / single_ns );
+	return 0;
+}
@@ -0,0 +1,129 @@
+// Measures Blip_Buffer::read_samples() throughput for mono and stereo output,
+// against the plain one-sample-at-a-time reader loop it replaced, and
+// read_samples_float() against reading 16-bit samples and converting them.
+
+#include "nes_apu/Blip_Buffer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+typedef std::chrono::steady_clock bench_clock;
+
+static int const sample_rate = 48000;
+static long const clock_rate = 1789773;
+static int const frame_length = clock_rate / 10; // 100 ms per frame
+static int const iterations = 400;
+
+// Fills buf with a frame of square waves plus some loud steps that force clamping
+static void fill_frame( Blip_Buffer& buf, Blip_Synth_Norm& synth, unsigned seed )
+{
+	int amp = 0;
+	for ( blip_time_t t = 0; t < frame_length; t += 1 + (seed >> 24) % 400 )
+	{
+		seed = seed * 1103515245 + 12345;
+		int new_amp = (seed >> 8) % 31 - 15;
+		if ( (seed & 0xF000) == 0 )
+			new_amp *= 8;
+		synth.offset( t, new_amp - amp, &buf );
+		amp = new_amp;
+	}
+	synth.offset( frame_length - 1, -amp, &buf );
+	buf.end_frame( frame_length );
+}
+
+// Reference reader using the public BLIP_READER macros
+static int read_reference( Blip_Buffer& buf, blip_sample_t out [], int max_samples, bool stereo )
+{
+	int count = buf.samples_avail();
+	if ( count > max_samples )
+		count = max_samples;
+
+	int const bass = BLIP_READER_BASS( buf );
+	BLIP_READER_BEGIN( reader, buf );
+	int const step = stereo ? 2 : 1;
+	for ( int i = 0; i < count; i++ )
+	{
+		int s = BLIP_READER_READ( reader );
+		BLIP_CLAMP( s, s );
+		out [i * step] = (blip_sample_t) s;
+		BLIP_READER_NEXT( reader, bass );
+	}
+	BLIP_READER_END( reader, buf );
+	buf.remove_samples( count );
+	return count;
+}
+
+static int read_library( Blip_Buffer& buf, blip_sample_t out [], int max_samples, bool stereo )
+{
+	return buf.read_samples( out, max_samples, stereo );
+}
+
+// Float output the way it had to be done before read_samples_float()
+static int read_converted( Blip_Buffer& buf, float out [], int max_samples, bool stereo )
+{
+	static std::vector<blip_sample_t> temp( sample_rate );
+	int count = buf.read_samples( temp.data(), max_samples, stereo );
+	int const step = stereo ? 2 : 1;
+	for ( int i = 0; i < count * step; i += step )
+		out [i] = temp [i] * (1.0f / 0x8000);
+	return count;
+}
+
+static int read_float( Blip_Buffer& buf, float out [], int max_samples, bool stereo )
+{
+	return buf.read_samples_float( out, max_samples, stereo );
+}
+
+// Returns nanoseconds per sample spent in read, and leaves last output in out
+template<class T>
+static double time_reads( int (*read)( Blip_Buffer&, T [], int, bool ), bool stereo,
+		std::vector<T>& out )
+{
+	Blip_Buffer buf;
+	if ( buf.set_sample_rate( sample_rate, 200 ) )
+		return 0;
+	buf.clock_rate( clock_rate );
+	Blip_Synth_Norm synth;
+	synth.volume( 0.5 );
+
+	bench_clock::duration elapsed = bench_clock::duration::zero();
+	long total = 0;
+	for ( int n = 0; n < iterations; n++ )
+	{
+		fill_frame( buf, synth, n );
+		std::fill( out.begin(), out.end(), (T) 0x1234 );
+
+		bench_clock::time_point start = bench_clock::now();
+		total += read( buf, out.data(), (int) out.size() / 2, stereo );
+		elapsed += bench_clock::now() - start;
+	}
+	return std::chrono::duration<double, std::nano>( elapsed ).count() / total;
+}
+
+int main()
+{
+	bool ok = true;
+	for ( int stereo = 0; stereo < 2; stereo++ )
+	{
+		std::vector<blip_sample_t> ref( sample_rate );
+		std::vector<blip_sample_t> out( sample_rate );
+		double ref_ns = time_reads( read_reference, stereo != 0, ref );
+		double lib_ns = time_reads( read_library,   stereo != 0, out );
+		bool same = (ref == out);
+		ok = ok && same;
+		printf( "%-6s reference %6.3f ns/sample, read_samples %6.3f ns/sample, %.2fx%s\n",
+				stereo ? "stereo" : "mono", ref_ns, lib_ns, ref_ns / lib_ns,
+				same ? "" : "  OUTPUT DIFFERS" );
+	}
+	for ( int stereo = 0; stereo < 2; stereo++ )
+	{
+		std::vector<float> out( sample_rate );
+		double conv_ns  = time_reads( read_converted, stereo != 0, out );
+		double float_ns = time_reads( read_float,     stereo != 0, out );
+		printf( "%-6s int16+convert %6.3f ns/sample, read_samples_float %6.3f ns/sample, %.2fx\n",
+				stereo ? "stereo" : "mono", conv_ns, float_ns, conv_ns / float_ns );
+	}
+	return ok ? 0 : 1;
+}
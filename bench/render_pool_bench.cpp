@@ -0,0 +1,147 @@
+// Measures Nes_Render_Pool throughput rendering a set of tracks with 1, 2, 4...
+// threads up to the number of processors, as seconds of audio per second.
+
+#include "nes_apu/Nes_Render_Pool.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+typedef std::chrono::steady_clock bench_clock;
+
+static int const sample_rate = 48000;
+static int const clock_rate = 1789773;
+static int const frame_length = clock_rate / 60;
+static int const track_secs = 20;
+static int const track_count = 64;
+
+// Writes notes to the squares, triangle and noise, and to VRC6 for every
+// other track, changing every few frames. With banks, VRC6 tracks also write
+// mapper registers at 0x8000-0x8FFF and 0xC000 up, which must be ignored.
+static std::vector<apu_write_t> make_track( unsigned seed, bool vrc6, bool banks = true )
+{
+	std::vector<apu_write_t> writes;
+	writes.push_back( { 0, 0x4015, 0x0F } );
+	writes.push_back( { 0, 0x4008, 0xFF } );
+	for ( int frame = 0; frame < track_secs * 60; frame += 6 )
+	{
+		int const time = frame * frame_length + 100;
+		for ( int osc = 0; osc < 4; osc++ )
+		{
+			seed = seed * 1103515245 + 12345;
+			uint16_t const addr = 0x4000 + osc * 4;
+			if ( osc != 2 )
+				writes.push_back( { time, addr, (uint8_t) (0x90 | (seed >> 24 & 15)) } );
+			writes.push_back( { time, (uint16_t) (addr + 2), (uint8_t) (seed >> 8) } );
+			writes.push_back( { time, (uint16_t) (addr + 3), (uint8_t) (0x08 | (seed >> 16 & 3)) } );
+		}
+		if ( vrc6 )
+		{
+			for ( int osc = 0; osc < 3; osc++ )
+			{
+				seed = seed * 1103515245 + 12345;
+				uint16_t const addr = 0x9000 + osc * 0x1000;
+				writes.push_back( { time, addr, (uint8_t) (0x40 | (seed >> 24 & 15)) } );
+				writes.push_back( { time, (uint16_t) (addr + 1), (uint8_t) (seed >> 8) } );
+				writes.push_back( { time, (uint16_t) (addr + 2), (uint8_t) (0x80 | (seed >> 16 & 7)) } );
+			}
+			if ( banks )
+			{
+				for ( int n = 0; n < 3; n++ )
+					writes.push_back( { time, (uint16_t) (0x8000 + n), (uint8_t) (seed >> 4) } );
+				writes.push_back( { time, 0xB003, 0x20 } );
+				writes.push_back( { time, 0xC000, (uint8_t) (seed >> 12) } );
+				writes.push_back( { time, 0xF001, 0x02 } );
+			}
+		}
+	}
+	return writes;
+}
+
+// Renders a VRC6 track with and without mapper writes and checks they sound
+// the same
+static bool banks_ignored()
+{
+	std::vector<apu_write_t> tracks [2] = { make_track( 1, true, false ), make_track( 1, true, true ) };
+	uint32_t hashes [2] = { 2166136261u, 2166136261u };
+	Nes_Render_Job jobs [2];
+	for ( int i = 0; i < 2; i++ )
+	{
+		Nes_Render_Job& job = jobs [i];
+		job.expansion = Nes_Render_Job::vrc6_chip;
+		job.pal = false;
+		job.writes = tracks [i].data();
+		job.write_count = tracks [i].size();
+		job.length = track_secs * 60 * frame_length;
+		uint32_t& hash = hashes [i];
+		job.sink = [&hash]( blip_sample_t const* in, int count ) {
+			for ( int n = 0; n < count; n++ )
+				hash = (hash ^ (uint16_t) in [n]) * 16777619u;
+		};
+	}
+	Nes_Render_Pool pool( 1 );
+	if ( pool.set_sample_rate( sample_rate ) )
+		return false;
+	pool.run( jobs, 2 );
+	return hashes [0] == hashes [1];
+}
+
+int main()
+{
+	if ( !banks_ignored() )
+	{
+		printf( "VRC6 mapper writes changed the sound\n" );
+		return 1;
+	}
+
+	std::vector<std::vector<apu_write_t> > tracks;
+	for ( int i = 0; i < track_count; i++ )
+		tracks.push_back( make_track( i, i & 1 ) );
+
+	std::atomic<long> total( 0 );
+	std::vector<Nes_Render_Job> jobs( track_count );
+	for ( int i = 0; i < track_count; i++ )
+	{
+		Nes_Render_Job& job = jobs [i];
+		job.expansion = (i & 1) ? Nes_Render_Job::vrc6_chip : Nes_Render_Job::no_chip;
+		job.pal = false;
+		job.writes = tracks [i].data();
+		job.write_count = tracks [i].size();
+		job.length = track_secs * 60 * frame_length;
+		job.sink = [&total]( blip_sample_t const* in, int count ) {
+			long sum = 0;
+			for ( int n = 0; n < count; n++ )
+				sum += in [n];
+			total += sum;
+		};
+	}
+
+	int const max_threads = std::thread::hardware_concurrency() ? std::thread::hardware_concurrency() : 1;
+	double single = 0;
+	for ( int threads = 1; ; threads *= 2 )
+	{
+		if ( threads > max_threads )
+			threads = max_threads;
+
+		Nes_Render_Pool pool( threads );
+		if ( pool.set_sample_rate( sample_rate ) )
+			return 1;
+		pool.run( jobs.data(), 1 ); // warm up
+
+		bench_clock::time_point start = bench_clock::now();
+		pool.run( jobs.data(), jobs.size() );
+		double secs = std::chrono::duration<double>( bench_clock::now() - start ).count();
+
+		double rate = track_count * track_secs / secs;
+		if ( threads == 1 )
+			single = rate;
+		printf( "%3d threads %8.0f sec/sec (%.1fx 1 thread)\n", threads, rate, rate / single );
+
+		if ( threads == max_threads )
+			break;
+	}
+	printf( "checksum %ld\n", (long) total );
+	return 0;
+}
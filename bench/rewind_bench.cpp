@@ -0,0 +1,131 @@
+// Measures Nes_Rewind_Ring capturing the state of an APU, a Namco chip and
+// their buffer every frame for several minutes: time per capture, ring memory
+// used per minute of history, and time per rewind step. Every rewound state is
+// checked against the one captured.
+
+#include "nes_apu/Nes_Apu.h"
+#include "nes_apu/Nes_Namco_Apu.h"
+#include "nes_apu/Nes_Rewind_Ring.h"
+#include "nes_apu/Nes_State.h"
+
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+typedef std::chrono::steady_clock bench_clock;
+
+static int const sample_rate = 48000;
+static int const clock_rate = 1789773;
+static int const frame_length = clock_rate / 60;
+static int const minutes = 5;
+static int const frame_count = minutes * 60 * 60;
+
+static uint32_t hash_state( void const* p, size_t size )
+{
+	uint32_t h = 2166136261u;
+	for ( size_t i = 0; i < size; i++ )
+		h = (h ^ ((uint8_t const*) p) [i]) * 16777619u;
+	return h;
+}
+
+int main()
+{
+	Blip_Buffer buf;
+	if ( buf.set_sample_rate( sample_rate ) )
+		return 1;
+	buf.clock_rate( clock_rate );
+
+	Nes_Apu apu;
+	apu.dmc_reader = []( int addr ) { return addr * 7 & 0xFF; };
+	apu.set_output( &buf );
+	apu.write_register( 0, 0x4015, 0x0F );
+	apu.write_register( 0, 0x4008, 0xFF );
+
+	Nes_Namco_Apu namco;
+	namco.set_output( &buf );
+	namco.write_addr( 0x80 );
+	for ( int i = 0; i < 0x40; i++ )
+		namco.write_data( 0, (uint8_t) (i * 37) ); // wave
+	namco.write_addr( 0x7F );
+	namco.write_data( 0, 0x30 ); // four channels
+
+	Nes_Rewind_Ring ring;
+	if ( ring.resize( 4096, 64 * 1024 * 1024 ) )
+		return 1;
+
+	static uint8_t state [4096];
+	static blip_sample_t samples [4096];
+	std::vector<uint32_t> hashes;
+	hashes.reserve( frame_count );
+	double save_secs = 0;
+	double capture_secs = 0;
+	unsigned seed = 1;
+	for ( int frame = 0; frame < frame_count; frame++ )
+	{
+		// notes change every few frames, like music
+		if ( frame % 6 == 0 )
+		{
+			for ( int osc = 0; osc < 4; osc++ )
+			{
+				seed = seed * 1103515245 + 12345;
+				uint16_t const addr = 0x4000 + osc * 4;
+				if ( osc != 2 )
+					apu.write_register( 100, addr, (uint8_t) (0x90 | (seed >> 24 & 15)) );
+				apu.write_register( 100, addr + 2, (uint8_t) (seed >> 8) );
+				apu.write_register( 100, addr + 3, (uint8_t) (0x08 | (seed >> 16 & 3)) );
+
+				namco.write_addr( 0x78 - osc * 8 );
+				namco.write_data( 200, (uint8_t) (seed >> 4) );
+				namco.write_addr( 0x7C - osc * 8 );
+				namco.write_data( 200, 0xE0 | (seed >> 20 & 3) );
+			}
+		}
+		apu.end_frame( frame_length );
+		namco.end_frame( frame_length );
+		buf.end_frame( frame_length );
+		while ( buf.read_samples( samples, sizeof samples / sizeof *samples ) ) { }
+
+		bench_clock::time_point start = bench_clock::now();
+		Nes_State_Writer out( state, sizeof state );
+		apu.save_state( out );
+		namco.save_state( out );
+		buf.save_state( out );
+		bench_clock::time_point saved = bench_clock::now();
+		if ( out.error() || ring.capture( state, out.size() ) )
+			return 1;
+		bench_clock::time_point end = bench_clock::now();
+		save_secs    += std::chrono::duration<double>( saved - start ).count();
+		capture_secs += std::chrono::duration<double>( end - saved ).count();
+		hashes.push_back( hash_state( state, out.size() ) );
+	}
+
+	printf( "state size     %6d bytes\n", (int) ring.state_size() );
+	printf( "save           %6.0f ns/frame\n", save_secs / frame_count * 1e9 );
+	printf( "capture        %6.0f ns/frame\n", capture_secs / frame_count * 1e9 );
+	printf( "ring memory    %6.0f KB/minute (%d states kept)\n",
+			ring.used() / 1024.0 / minutes, ring.count() + 1 );
+
+	// rewind all the way, checking each state and that it loads
+	bench_clock::time_point start = bench_clock::now();
+	int steps = 0;
+	do
+	{
+		if ( hash_state( ring.state(), ring.state_size() ) != hashes [frame_count - 1 - steps] )
+		{
+			printf( "state %d differs\n", steps );
+			return 1;
+		}
+		steps++;
+	}
+	while ( ring.rewind() );
+	double secs = std::chrono::duration<double>( bench_clock::now() - start ).count();
+	printf( "rewind         %6.0f ns/step, %d steps\n", secs / steps * 1e9, steps );
+
+	Nes_State_Reader in( ring.state(), ring.state_size() );
+	if ( apu.load_state( in ) || namco.load_state( in ) || buf.load_state( in ) )
+	{
+		printf( "load failed\n" );
+		return 1;
+	}
+	return 0;
+}
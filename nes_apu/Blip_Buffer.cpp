@@ -1,8 +1,16 @@
 #include "Blip_Buffer.h"
+#include "Nes_State.h"
 
 #include <cmath>
 #include <climits>
 #include <cstring>
+#include <mutex>
+#include <typeinfo>
+
+#if BLIP_PHASE_BITS == 6 && !BLIP_BUFFER_FAST && !defined (BLIP_NO_KERNEL_TABLES)
+	#define BLIP_KERNEL_TABLES 1
+	#include "Blip_Buffer_kernels.h"
+#endif
 
 /* Copyright (C) 2003-2008 Shay Green. This module is free software; you
 can redistribute it and/or modify it under the terms of the GNU Lesser
@@ -21,11 +29,15 @@ Blip_Buffer::Blip_Buffer()
 {
 	factor_      = UINT_MAX/2 + 1;
 	buffer_      = nullptr;
+	buffer_alloc_ = nullptr;
 	buffer_center_ = nullptr;
 	buffer_size_ = 0;
 	sample_rate_ = 0;
 	bass_shift_  = 0;
 	clock_rate_  = 0;
+	rate_adjustment_ = 1.0;
+	factor_frac_ = 0;
+	frac_accum_  = 0;
 	bass_freq_   = 16;
 	length_      = 0;
 	
@@ -45,7 +57,7 @@ Blip_Buffer::Blip_Buffer()
 
 Blip_Buffer::~Blip_Buffer()
 {
-	free( buffer_ );
+	free( buffer_alloc_ );
 }
 
 void Blip_Buffer::clear()
@@ -53,40 +65,46 @@ void Blip_Buffer::clear()
 	bool const entire_buffer = true;
 	
 	offset_       = 0;
+	frac_accum_   = 0;
 	reader_accum_ = 0;
 	modified_     = false;
 	
-	if ( buffer_ )
+	if ( buffer_alloc_ )
 	{
-		int count = (entire_buffer ? buffer_size_ : samples_avail());
+		int count = (entire_buffer ? buffer_size_ * 2 : samples_avail());
+		buffer_        = buffer_alloc_;
+		buffer_center_ = buffer_ + BLIP_MAX_QUALITY/2;
 		memset( buffer_, 0, (count + blip_buffer_extra_) * sizeof (delta_t) );
 	}
 }
 
 std::error_condition Blip_Buffer::set_sample_rate( int new_rate, int msec )
 {
-	// Limit to maximum size that resampled time can represent
-	int max_size = (((blip_resampled_time_t) -1) >> BLIP_BUFFER_ACCURACY) -
-			blip_buffer_extra_ - 64; // TODO: -64 isn't needed
-	int new_size = (new_rate * (msec + 1) + 999) / 1000;
-	if ( new_size > max_size )
-		new_size = max_size;
+	// Limit to maximum size that resampled time can represent, and that sizes
+	// in samples and bytes can
+	blip_resampled_time_t max_time = ((blip_resampled_time_t) -1) >> BLIP_BUFFER_ACCURACY;
+	if ( max_time > INT_MAX / 4 / sizeof *buffer_ )
+		max_time = INT_MAX / 4 / sizeof *buffer_;
+	int max_size = (int) max_time - blip_buffer_extra_ - 64; // TODO: -64 isn't needed
+	long long new_size_ = ((long long) new_rate * (msec + 1) + 999) / 1000;
+	int new_size = (new_size_ > max_size ? max_size : (int) new_size_);
 	
 	// Resize buffer
 	if ( buffer_size_ != new_size )
 	{
 		//dprintf( "%d \n", (new_size + blip_buffer_extra_) * sizeof *buffer_  );
-		void* p = realloc( buffer_, (new_size + blip_buffer_extra_) * sizeof *buffer_ );
+		void* p = realloc( buffer_alloc_, (new_size * 2 + blip_buffer_extra_) * sizeof *buffer_ );
 		if (!p)
 			return std::make_error_condition(std::errc::not_enough_memory);
-		buffer_      = (delta_t*) p;
+		buffer_alloc_ = (delta_t*) p;
+		buffer_      = buffer_alloc_;
 		buffer_center_ = buffer_ + BLIP_MAX_QUALITY/2;
 		buffer_size_ = new_size;
 	}
 	
 	// Update sample_rate and things that depend on it
 	sample_rate_ = new_rate;
-	length_      = new_size * 1000 / new_rate - 1;
+	length_      = (int) ((long long) new_size * 1000 / new_rate - 1);
 	if ( clock_rate_ )
 		clock_rate( clock_rate_ );
 	bass_freq( bass_freq_ );
@@ -104,6 +122,32 @@ blip_resampled_time_t Blip_Buffer::clock_rate_factor( int rate ) const
 	return (blip_resampled_time_t) factor;
 }
 
+void Blip_Buffer::clock_rate( int rate )
+{
+	clock_rate_  = rate;
+	factor_      = clock_rate_factor( rate );
+	factor_frac_ = 0;
+	if ( rate_adjustment_ != 1.0 && sample_rate_ )
+	{
+		// Adjustment scales the same rounded factor used at 1.0, so the rate
+		// changes monotonically with it. Factor has only BLIP_BUFFER_ACCURACY
+		// fraction bits, too coarse for small adjustments, so the rest is kept
+		// separately and carried by end_frame().
+		double factor = (double) factor_ * rate_adjustment_;
+		factor_      = (blip_resampled_time_t) factor;
+		factor_frac_ = (unsigned) ((factor - factor_) * 0x10000);
+		assert( factor_ > 0 ); // fails if clock/output ratio is too large
+	}
+}
+
+void Blip_Buffer::set_rate_adjustment( double ratio )
+{
+	assert( ratio > 0 );
+	rate_adjustment_ = ratio;
+	if ( clock_rate_ )
+		clock_rate( clock_rate_ );
+}
+
 void Blip_Buffer::bass_freq( int freq )
 {
 	bass_freq_ = freq;
@@ -120,6 +164,12 @@ void Blip_Buffer::bass_freq( int freq )
 void Blip_Buffer::end_frame( blip_time_t t )
 {
 	offset_ += t * factor_;
+	if ( factor_frac_ )
+	{
+		unsigned long long frac = frac_accum_ + (unsigned long long) t * factor_frac_;
+		offset_ += (blip_resampled_time_t) (frac >> 16);
+		frac_accum_ = (unsigned) frac & 0xFFFF;
+	}
 	assert( samples_avail() <= (int) buffer_size_ ); // fails if time is past end of buffer
 }
 
@@ -144,13 +194,233 @@ void Blip_Buffer::remove_samples( int count )
 	{
 		remove_silence( count );
 		
-		// copy remaining samples to beginning and clear old samples
-		int remain = samples_avail() + blip_buffer_extra_;
-		memmove( buffer_, buffer_ + count, remain * sizeof *buffer_ );
-		memset( buffer_ + remain, 0, count * sizeof *buffer_ );
+		// slide window past removed samples
+		buffer_        += count;
+		buffer_center_ += count;
+		
+		// once window could run past end of allocation, copy remaining samples to
+		// beginning and clear everything after them. This happens at most once per
+		// buffer_size_ samples removed, so removal is O(count) on average.
+		int slid = (int) (buffer_ - buffer_alloc_);
+		if ( slid > buffer_size_ )
+		{
+			int remain = samples_avail() + blip_buffer_extra_;
+			memmove( buffer_alloc_, buffer_, remain * sizeof *buffer_ );
+			memset( buffer_alloc_ + remain, 0, slid * sizeof *buffer_ );
+			buffer_        = buffer_alloc_;
+			buffer_center_ = buffer_ + BLIP_MAX_QUALITY/2;
+		}
 	}
 }
 
+// Samples are integrated into blocks of this size before being converted and stored
+int const read_block_size = 64;
+
+// Raw sample value corresponding to 1.0
+float const raw_float_scale = 1.0f / (1 << (blip_sample_bits - 1));
+
+// Converts count raw samples from in to float, advancing out by step (1 or 2) each time
+static float* blip_store_float( int const in [], int count, float* out, int step )
+{
+	int i = 0;
+	#if BLIP_SSE2
+		__m128 const scale = _mm_set1_ps( raw_float_scale );
+		if ( step == 1 )
+		{
+			for ( ; i + 4 <= count; i += 4 )
+			{
+				__m128 s = _mm_cvtepi32_ps( _mm_loadu_si128( (__m128i const*) &in [i] ) );
+				_mm_storeu_ps( &out [i], _mm_mul_ps( s, scale ) );
+			}
+		}
+		else
+		{
+			// merge into even elements, leaving other channel intact; stops before
+			// last sample so that nothing past end of caller's buffer is touched
+			__m128 const even = _mm_castsi128_ps( _mm_set_epi32( 0, -1, 0, -1 ) );
+			for ( ; i + 4 < count; i += 4 )
+			{
+				__m128 s = _mm_cvtepi32_ps( _mm_loadu_si128( (__m128i const*) &in [i] ) );
+				s = _mm_mul_ps( s, scale );
+				float* p = &out [i * 2];
+				__m128 lo = _mm_and_ps( _mm_unpacklo_ps( s, s ), even );
+				__m128 hi = _mm_and_ps( _mm_unpackhi_ps( s, s ), even );
+				_mm_storeu_ps( p    , _mm_or_ps( lo, _mm_andnot_ps( even, _mm_loadu_ps( p     ) ) ) );
+				_mm_storeu_ps( p + 4, _mm_or_ps( hi, _mm_andnot_ps( even, _mm_loadu_ps( p + 4 ) ) ) );
+			}
+		}
+	#elif BLIP_NEON
+		float32x4_t const scale = vdupq_n_f32( raw_float_scale );
+		if ( step == 1 )
+		{
+			for ( ; i + 4 <= count; i += 4 )
+				vst1q_f32( &out [i], vmulq_f32( vcvtq_f32_s32( vld1q_s32( &in [i] ) ), scale ) );
+		}
+		else
+		{
+			for ( ; i + 4 < count; i += 4 )
+			{
+				float32x4x2_t v = vld2q_f32( &out [i * 2] );
+				v.val [0] = vmulq_f32( vcvtq_f32_s32( vld1q_s32( &in [i] ) ), scale );
+				vst2q_f32( &out [i * 2], v );
+			}
+		}
+	#endif
+	
+	out += i * step;
+	for ( ; i < count; i++ )
+	{
+		*out = in [i] * raw_float_scale;
+		out += step;
+	}
+	return out;
+}
+
+void Blip_Buffer::raw_to_float( int const in [], float out [], int count )
+{
+	blip_store_float( in, count, out, 1 );
+}
+
+int Blip_Buffer::read_samples_float( float out [], int max_samples, bool stereo )
+{
+	int count = samples_avail();
+	if ( count > max_samples )
+		count = max_samples;
+	
+	if ( count )
+	{
+		int const bass = highpass_shift();
+		delta_t const* __restrict reader = read_pos();
+		int reader_sum = integrator();
+		int const step = stereo ? 2 : 1;
+		
+		int block [read_block_size];
+		int remain = count;
+		do
+		{
+			int n = remain < read_block_size ? remain : read_block_size;
+			for ( int i = 0; i < n; i++ )
+			{
+				block [i] = reader_sum;
+				reader_sum = (reader_sum + reader [i]) - (reader_sum >> bass);
+			}
+			reader += n;
+			remain -= n;
+			
+			out = blip_store_float( block, n, out, step );
+		}
+		while ( remain );
+		
+		set_integrator( reader_sum );
+		
+		remove_samples( count );
+	}
+	return count;
+}
+
+#if BLIP_SSE2 || BLIP_NEON
+
+// Clamps count samples from in to out, advancing out by step (1 or 2) each time
+static blip_sample_t* blip_store_samples( int const in [], int count, blip_sample_t* out, int step )
+{
+	int i = 0;
+	#if BLIP_SSE2
+		if ( step == 1 )
+		{
+			for ( ; i + 8 <= count; i += 8 )
+			{
+				__m128i a = _mm_loadu_si128( (__m128i const*) &in [i] );
+				__m128i b = _mm_loadu_si128( (__m128i const*) &in [i + 4] );
+				_mm_storeu_si128( (__m128i*) &out [i], _mm_packs_epi32( a, b ) );
+			}
+		}
+		else
+		{
+			// merge into even elements, leaving other channel intact; stops before
+			// last sample so that nothing past end of caller's buffer is touched
+			__m128i const other = _mm_set1_epi32( (int) 0xFFFF0000 );
+			for ( ; i + 4 < count; i += 4 )
+			{
+				__m128i s = _mm_loadu_si128( (__m128i const*) &in [i] );
+				s = _mm_unpacklo_epi16( _mm_packs_epi32( s, s ), _mm_setzero_si128() );
+				__m128i* p = (__m128i*) &out [i * 2];
+				_mm_storeu_si128( p, _mm_or_si128( s, _mm_and_si128( _mm_loadu_si128( p ), other ) ) );
+			}
+		}
+	#else
+		if ( step == 1 )
+		{
+			for ( ; i + 8 <= count; i += 8 )
+			{
+				int16x4_t a = vqmovn_s32( vld1q_s32( &in [i] ) );
+				int16x4_t b = vqmovn_s32( vld1q_s32( &in [i + 4] ) );
+				vst1q_s16( &out [i], vcombine_s16( a, b ) );
+			}
+		}
+		else
+		{
+			// same end condition as above, since this also loads the other channel
+			for ( ; i + 4 < count; i += 4 )
+			{
+				int16x4x2_t v = vld2_s16( &out [i * 2] );
+				v.val [0] = vqmovn_s32( vld1q_s32( &in [i] ) );
+				vst2_s16( &out [i * 2], v );
+			}
+		}
+	#endif
+	
+	out += i * step;
+	for ( ; i < count; i++ )
+	{
+		int s = in [i];
+		BLIP_CLAMP( s, s );
+		*out = (blip_sample_t) s;
+		out += step;
+	}
+	return out;
+}
+
+int Blip_Buffer::read_samples( blip_sample_t out [], int max_samples, bool stereo )
+{
+	int count = samples_avail();
+	if ( count > max_samples )
+		count = max_samples;
+	
+	if ( count )
+	{
+		int const bass = highpass_shift();
+		delta_t const* __restrict reader = read_pos();
+		int reader_sum = integrator();
+		int const step = stereo ? 2 : 1;
+		
+		// The integrator is inherently serial, so it runs into a small block of
+		// unclamped samples which are then clamped and stored several at a time.
+		int block [read_block_size];
+		int remain = count;
+		do
+		{
+			int n = remain < read_block_size ? remain : read_block_size;
+			for ( int i = 0; i < n; i++ )
+			{
+				block [i] = reader_sum >> delta_bits;
+				reader_sum = (reader_sum + reader [i]) - (reader_sum >> bass);
+			}
+			reader += n;
+			remain -= n;
+			
+			out = blip_store_samples( block, n, out, step );
+		}
+		while ( remain );
+		
+		set_integrator( reader_sum );
+		
+		remove_samples( count );
+	}
+	return count;
+}
+
+#else
+
 int Blip_Buffer::read_samples( blip_sample_t out_ [], int max_samples, bool stereo )
 {
 	int count = samples_avail();
@@ -204,6 +474,8 @@ int Blip_Buffer::read_samples( blip_sample_t out_ [], int max_samples, bool ster
 	return count;
 }
 
+#endif
+
 void Blip_Buffer::mix_samples( blip_sample_t const in [], int count )
 {
 	delta_t* out = buffer_center_ + (offset_ >> BLIP_BUFFER_ACCURACY);
@@ -237,6 +509,60 @@ void Blip_Buffer::load_state( blip_buffer_state_t const& in )
 	memcpy( buffer_, in.buf, sizeof in.buf );
 }
 
+uint32_t const blip_state_tag = nes_state_tag( "BLIP" );
+int const blip_state_version = 1;
+
+void Blip_Buffer::save_state( Nes_State_Writer& out, blip_time_t time ) const
+{
+	// samples to read, then deltas added after them up to time
+	int const avail = samples_avail();
+	int count = (int) (to_fixed( time > 0 ? time : 0 ) >> fixed_bits) + blip_buffer_extra_;
+	if ( count > buffer_size_ + blip_buffer_extra_ )
+		count = buffer_size_ + blip_buffer_extra_;
+	
+	out.begin_block( blip_state_tag, blip_state_version );
+	out.write8 ( fixed_bits );
+	out.write32( (int32_t) (offset_ & (fixed_unit - 1)) );
+	out.write32( (int32_t) frac_accum_ );
+	out.write32( reader_accum_ );
+	out.write8 ( modified_ );
+	out.write32( avail );
+	out.write32( count );
+	for ( int i = 0; i < count; i++ )
+		out.write32( buffer_ [i] );
+	out.end_block();
+}
+
+std::error_condition Blip_Buffer::load_state( Nes_State_Reader& in )
+{
+	clear();
+	if ( in.begin_block( blip_state_tag, blip_state_version ) )
+	{
+		int const bits = in.read8();
+		fixed_t frac = (uint32_t) in.read32();
+		frac = (bits > fixed_bits ? frac >> (bits - fixed_bits) : frac << (fixed_bits - bits));
+		frac_accum_   = (uint32_t) in.read32();
+		reader_accum_ = in.read32();
+		modified_     = in.read8() != 0;
+		int const avail = in.read32();
+		int const count = in.read32();
+		if ( (unsigned) avail > (unsigned) buffer_size_ ||
+				(unsigned) count > (unsigned) (buffer_size_ + blip_buffer_extra_) )
+		{
+			in.end_block();
+			clear();
+			return std::make_error_condition( std::errc::no_buffer_space );
+		}
+		offset_ = ((fixed_t) avail << fixed_bits) + frac;
+		for ( int i = 0; i < count; i++ )
+			buffer_ [i] = in.read32();
+		in.end_block();
+	}
+	
+	if ( in.error() )
+		clear();
+	return in.error();
+}
 
 //// Blip_Synth_
 
@@ -258,17 +584,6 @@ void blip_eq_t::generate( float* out, int count ) const { }
 
 #else
 
-Blip_Synth_::Blip_Synth_( short p [], int w ) :
-	phases( p ),
-	width( w )
-{
-	volume_unit_ = 0.0;
-	kernel_unit  = 0;
-	buf          = nullptr;
-	last_amp     = 0;
-	delta_factor = 0;
-}
-
 #undef PI
 #define PI 3.1415926535897932384626433832795029
 
@@ -356,8 +671,158 @@ void blip_eq_t::generate( float out [], int count ) const
 	kaiser_window( out, count, kaiser );
 }
 
-void Blip_Synth_::treble_eq( blip_eq_t const& eq )
+//// blip_kernel_t
+
+// Kernel table shared by all synths with the same width, eq and volume rescaling.
+// Tables are immutable once created and are freed when the last synth releases them.
+struct blip_kernel_t
+{
+	short phases [blip_res / 2 * BLIP_MAX_QUALITY];
+	blip_kernel_t* next;
+	blip_kernel_t* parent; // kernel this was rescaled from, or null if generated from eq
+	int refs;
+	int width;
+	int kernel_unit;
+	int shift;             // amount parent was rescaled by
+	bool shared;           // false if generated by a blip_eq_t subclass, which can't be compared
+	double treble, kaiser;
+	int rolloff_freq, sample_rate, cutoff_freq;
+	
+	bool same_eq( blip_eq_t const& eq ) const;
+	void generate( blip_eq_t const& );
+	void adjust_impulse();
+	void rescale( int shift );
+	int impulses_size() const { return blip_res / 2 * width; }
+	
+	static blip_kernel_t* find( blip_eq_t const&, int width );
+	static blip_kernel_t* find_rescaled( blip_kernel_t* parent, int shift );
+	static void release( blip_kernel_t* );
+};
+
+// All kernels in use. Never destroyed, so that synths in static objects can be safely
+// destroyed in any order at exit.
+struct blip_kernel_list_t
+{
+	std::mutex mutex;
+	blip_kernel_t* head;
+};
+
+static blip_kernel_list_t& blip_kernels()
+{
+	static blip_kernel_list_t* list = new blip_kernel_list_t();
+	return *list;
+}
+
+bool blip_kernel_t::same_eq( blip_eq_t const& eq ) const
+{
+	return treble == eq.treble && kaiser == eq.kaiser && rolloff_freq == eq.rolloff_freq &&
+			sample_rate == eq.sample_rate && cutoff_freq == eq.cutoff_freq;
+}
+
+blip_kernel_t* blip_kernel_t::find( blip_eq_t const& eq, int width )
+{
+	// a subclass can generate anything, so it always gets its own kernel
+	bool const shared = (typeid (eq) == typeid (blip_eq_t));
+	
+	blip_kernel_list_t& list = blip_kernels();
+	std::lock_guard<std::mutex> lock( list.mutex );
+	if ( shared )
+	{
+		for ( blip_kernel_t* k = list.head; k; k = k->next )
+		{
+			if ( k->shared && !k->parent && k->width == width && k->same_eq( eq ) )
+			{
+				k->refs++;
+				return k;
+			}
+		}
+	}
+	
+	blip_kernel_t* k = new blip_kernel_t();
+	k->parent       = nullptr;
+	k->refs         = 1;
+	k->width        = width;
+	k->shift        = 0;
+	k->shared       = shared;
+	k->treble       = eq.treble;
+	k->kaiser       = eq.kaiser;
+	k->rolloff_freq = eq.rolloff_freq;
+	k->sample_rate  = eq.sample_rate;
+	k->cutoff_freq  = eq.cutoff_freq;
+	k->generate( eq );
+	
+	k->next   = list.head;
+	list.head = k;
+	return k;
+}
+
+blip_kernel_t* blip_kernel_t::find_rescaled( blip_kernel_t* parent, int shift )
+{
+	blip_kernel_list_t& list = blip_kernels();
+	std::lock_guard<std::mutex> lock( list.mutex );
+	for ( blip_kernel_t* k = list.head; k; k = k->next )
+	{
+		if ( k->parent == parent && k->shift == shift )
+		{
+			k->refs++;
+			return k;
+		}
+	}
+	
+	blip_kernel_t* k = new blip_kernel_t( *parent );
+	parent->refs++;
+	k->parent = parent;
+	k->refs   = 1;
+	k->shift  = shift;
+	k->kernel_unit = parent->kernel_unit >> shift;
+	k->rescale( shift );
+	
+	k->next   = list.head;
+	list.head = k;
+	return k;
+}
+
+void blip_kernel_t::release( blip_kernel_t* k )
 {
+	blip_kernel_list_t& list = blip_kernels();
+	std::lock_guard<std::mutex> lock( list.mutex );
+	while ( k && --k->refs == 0 )
+	{
+		blip_kernel_t** p = &list.head;
+		while ( *p != k )
+			p = &(*p)->next;
+		*p = k->next;
+		
+		blip_kernel_t* parent = k->parent;
+		delete k;
+		k = parent;
+	}
+}
+
+void blip_kernel_t::generate( blip_eq_t const& eq )
+{
+	#if BLIP_KERNEL_TABLES
+		// Default eq has a precomputed kernel. Sample rate only matters if one of the
+		// frequencies is set.
+		if ( shared && treble == -8.0 && kaiser == 5.2 && !rolloff_freq && !cutoff_freq &&
+				sample_rate > 0 )
+		{
+			short const* table = nullptr;
+			switch ( width )
+			{
+				case  8: table = blip_default_kernel_8;  break;
+				case 12: table = blip_default_kernel_12; break;
+				case 16: table = blip_default_kernel_16; break;
+			}
+			if ( table )
+			{
+				kernel_unit = 32768;
+				memcpy( phases, table, impulses_size() * sizeof *phases );
+				return;
+			}
+		}
+	#endif
+	
 	// Generate right half of kernel
 	int const half_size = blip_eq_t::calc_count( width );
 	float fimpulse [blip_res / 2 * (BLIP_MAX_QUALITY - 1) + 1];
@@ -404,17 +869,9 @@ void Blip_Synth_::treble_eq( blip_eq_t const& eq )
 	}
 	
 	adjust_impulse();
-	
-	// volume might require rescaling
-	double vol = volume_unit_;
-	if ( vol )
-	{
-		volume_unit_ = 0.0;
-		volume_unit( vol );
-	}
 }
 
-void Blip_Synth_::adjust_impulse()
+void blip_kernel_t::adjust_impulse()
 {
 	int const size = impulses_size();
 	int const half_width = width / 2;
@@ -445,7 +902,7 @@ void Blip_Synth_::adjust_impulse()
 	#endif
 }
 
-void Blip_Synth_::rescale_kernel( int shift )
+void blip_kernel_t::rescale( int shift )
 {
 	// Keep values positive to avoid round-towards-zero of sign-preserving
 	// right shift for negative values.
@@ -470,6 +927,74 @@ void Blip_Synth_::rescale_kernel( int shift )
 	adjust_impulse();
 }
 
+//// Blip_Synth_
+
+// Used until a kernel is selected, so that synthesis before volume() is harmless
+static short const blip_no_kernel [blip_res / 2 * BLIP_MAX_QUALITY] = { 0 };
+
+Blip_Synth_::Blip_Synth_( int w ) :
+	width( w )
+{
+	volume_unit_ = 0.0;
+	kernel_unit  = 0;
+	kernel       = nullptr;
+	phases       = blip_no_kernel;
+	buf          = nullptr;
+	last_amp     = 0;
+	delta_factor = 0;
+}
+
+Blip_Synth_::Blip_Synth_( Blip_Synth_ const& in ) :
+	width( in.width )
+{
+	kernel = nullptr;
+	*this = in;
+}
+
+Blip_Synth_& Blip_Synth_::operator = ( Blip_Synth_ const& in )
+{
+	assert( width == in.width );
+	if ( in.kernel )
+	{
+		std::lock_guard<std::mutex> lock( blip_kernels().mutex );
+		in.kernel->refs++;
+	}
+	set_kernel( in.kernel );
+	volume_unit_ = in.volume_unit_;
+	kernel_unit  = in.kernel_unit;
+	buf          = in.buf;
+	last_amp     = in.last_amp;
+	delta_factor = in.delta_factor;
+	return *this;
+}
+
+Blip_Synth_::~Blip_Synth_()
+{
+	blip_kernel_t::release( kernel );
+}
+
+// Takes ownership of reference to k and releases current kernel
+void Blip_Synth_::set_kernel( blip_kernel_t* k )
+{
+	blip_kernel_t::release( kernel );
+	kernel = k;
+	phases = (k ? k->phases : blip_no_kernel);
+}
+
+void Blip_Synth_::treble_eq( blip_eq_t const& eq )
+{
+	set_kernel( blip_kernel_t::find( eq, width ) );
+	kernel_unit = kernel->kernel_unit;
+	
+	// volume might require rescaling
+	double vol = volume_unit_;
+	if ( vol )
+	{
+		volume_unit_ = 0.0;
+		volume_unit( vol );
+	}
+}
+
 void Blip_Synth_::volume_unit( double new_unit )
 {
 	if ( volume_unit_ != new_unit )
@@ -497,7 +1022,7 @@ void Blip_Synth_::volume_unit( double new_unit )
 				kernel_unit >>= shift;
 				assert( kernel_unit > 0 ); // fails if volume unit is too low
 				
-				rescale_kernel( shift );
+				set_kernel( blip_kernel_t::find_rescaled( kernel, shift ) );
 			}
 		}
 		
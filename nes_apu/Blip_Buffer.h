@@ -12,18 +12,29 @@ typedef int blip_time_t;                    // Source clocks in current time fra
 typedef int16_t blip_sample_t;       // 16-bit signed output sample
 int const blip_default_length = 1000 / 4;   // Default Blip_Buffer length (1/4 second)
 
+class Nes_State_Writer;
+class Nes_State_Reader;
+
 
 //// Sample buffer for band-limited synthesis
 
 class DLLEXPORT Blip_Buffer : public Blip_Buffer_ {
 public:
 
-	// Sets output sample rate and resizes and clears sample buffer
+	// Sets output sample rate and resizes and clears sample buffer. Length is
+	// limited to 65535 samples unless BLIP_RESAMPLED_TIME_64 is defined.
 	std::error_condition set_sample_rate( int samples_per_sec, int msec_length = blip_default_length );
 	
 	// Sets number of source time units per second
 	void clock_rate( int clocks_per_sec );
 	
+	// Scales resampling ratio by ratio, so that a frame produces that many times
+	// as many samples, without clearing buffer. Can be changed between frames,
+	// for example by a fraction of a percent to keep an audio device's queue
+	// at a steady level. Default is 1.0.
+	void set_rate_adjustment( double ratio );
+	double rate_adjustment() const;
+	
 	// Clears buffer and removes all samples
 	void clear();
 	
@@ -40,6 +51,10 @@ public:
 	// is true, writes to out [0], out [2], out [4] etc. instead.
 	int read_samples( blip_sample_t out [], int n, bool stereo = false );
 	
+	// Same as read_samples(), but writes floating-point samples at full internal
+	// resolution and without clamping, where -1.0 to +1.0 is the 16-bit output range
+	int read_samples_float( float out [], int n, bool stereo = false );
+	
 // More features
 
 	// Sets flag that tells some Multi_Buffer types that sound was added to buffer,
@@ -70,6 +85,10 @@ public:
 	
 	// Mixes n samples into buffer
 	void mix_samples( const blip_sample_t in [], int n );
+	
+	// Converts n raw samples (see BLIP_READER_READ_RAW) to the floating-point scale
+	// used by read_samples_float()
+	static void raw_to_float( const int in [], float out [], int n );
 
 // Resampled time (sorry, poor documentation right now)
 	
@@ -81,7 +100,8 @@ public:
 	// Converts clock time since beginning of current time frame to resampled time
 	blip_resampled_time_t resampled_time( blip_time_t t ) const     { return t * factor_ + offset_; }
 	
-	// Returns factor that converts clock rate to resampled time
+	// Returns factor that converts clock rate to resampled time, without any
+	// rate adjustment
 	blip_resampled_time_t clock_rate_factor( int clock_rate ) const;
 	
 // State save/load
@@ -95,6 +115,16 @@ public:
 	// settings during same run of program; states can NOT be stored on disk.
 	// Clears buffer before loading state.
 	void load_state( const blip_buffer_state_t& in );
+	
+	// Saves state in portable format (see Nes_State.h), including any samples
+	// not yet read. If saving in the middle of a time frame, time is the clock
+	// that output has been added up to, so those deltas are saved too.
+	void save_state( Nes_State_Writer&, blip_time_t time = 0 ) const;
+	
+	// Loads state saved by save_state( Nes_State_Writer& ). Buffer should have
+	// the same sample rate and clock rate as when state was saved. Buffer is
+	// cleared if there's an error.
+	std::error_condition load_state( Nes_State_Reader& );
 
 private:
 	// noncopyable
@@ -152,6 +182,12 @@ public:
 	// to convert clock counts to resampled time.
 	void offset_resampled( blip_resampled_time_t, int delta, Blip_Buffer* ) const;
 	
+	// Same as offset() and offset_resampled(), but adds n transitions at once, with
+	// delta [i] at time t [i]. Times can be in any order.
+	void offset_batch( const blip_time_t t [], const int delta [], int n, Blip_Buffer* ) const;
+	void offset_resampled_batch( const blip_resampled_time_t t [], const int delta [], int n,
+			Blip_Buffer* ) const;
+	
 // Implementation
 private:
 #if BLIP_BUFFER_FAST
@@ -160,10 +196,8 @@ private:
 #else
 	Blip_Synth_ impl;
 	typedef short coeff_t;
-	// Left halves of first difference of step response for each possible phase
-	coeff_t phases [quality / 2 * blip_res];
 public:
-	Blip_Synth() : impl( phases, quality ) { }
+	Blip_Synth() : impl( quality ) { }
 #endif
 };
 
@@ -173,6 +207,7 @@ public:
 class blip_eq_t {
 	double treble, kaiser;
 	int rolloff_freq, sample_rate, cutoff_freq;
+	friend struct blip_kernel_t;
 public:
 	// Logarithmic rolloff to treble dB at half sampling rate. Negative values reduce
 	// treble, small positive values (0 to 5.0) increase treble.
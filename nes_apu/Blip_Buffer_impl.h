@@ -4,8 +4,16 @@
 #define BLIP_BUFFER_IMPL_H
 
 #include <assert.h>
-
-typedef unsigned blip_resampled_time_t;
+#include <cstdint>
+
+// Resampled time is 32 bits by default, which limits buffers to 65535 samples
+// (about 1.4 seconds at 44.1 kHz). Define BLIP_RESAMPLED_TIME_64 to 1 to make it
+// 64 bits and lift the limit, at some cost in speed on 32-bit CPUs.
+#if BLIP_RESAMPLED_TIME_64
+	typedef uint64_t blip_resampled_time_t;
+#else
+	typedef unsigned blip_resampled_time_t;
+#endif
 
 #ifndef BLIP_MAX_QUALITY
 	#define BLIP_MAX_QUALITY 32
@@ -41,7 +49,7 @@ public:
 	typedef int clocks_t;
 	
 	// Properties of fixed-point sample position
-	typedef unsigned fixed_t; // unsigned for more range, optimized shifts
+	typedef blip_resampled_time_t fixed_t; // unsigned for more range, optimized shifts
 	enum { fixed_bits = BLIP_BUFFER_ACCURACY };             // bits in fraction
 	enum { fixed_unit = 1 << fixed_bits };  // 1.0 samples
 
@@ -72,15 +80,19 @@ public: //friend class Tracked_Blip_Buffer; private:
 	void remove_silence( int count );
 	
 private:
-	unsigned factor_;
+	fixed_t  factor_;
 	fixed_t  offset_;
 	delta_t* buffer_center_;
 	int      buffer_size_;
 	int      reader_accum_;
 	int      bass_shift_;
-	delta_t* buffer_;
+	delta_t* buffer_;       // read position; slides forward through buffer_alloc_
+	delta_t* buffer_alloc_; // room for twice buffer_size_, so removal rarely has to copy
 	int      sample_rate_;
 	int      clock_rate_;
+	double   rate_adjustment_;
+	unsigned factor_frac_;  // fraction of factor_ below fixed-point precision, in 1/0x10000 units
+	unsigned frac_accum_;   // fraction carried to offset_ so far
 	int      bass_freq_;
 	int      length_;
 	bool     modified_;
@@ -99,24 +111,31 @@ public:
 	Blip_Synth_Fast_();
 };
 
+struct blip_kernel_t;
+
 class DLLEXPORT Blip_Synth_ {
 public:
 	int delta_factor;
 	int last_amp;
 	Blip_Buffer* buf;
 	
+	// Left halves of first difference of step response for each possible phase.
+	// Read-only and shared between all synths with the same width, eq and volume.
+	short const* phases;
+	
 	void volume_unit( double );
 	void treble_eq( blip_eq_t const& );
-	Blip_Synth_( short phases [], int width );
+	Blip_Synth_( int width );
+	Blip_Synth_( Blip_Synth_ const& );
+	Blip_Synth_& operator = ( Blip_Synth_ const& );
+	~Blip_Synth_();
 private:
 	double volume_unit_;
-	short* const phases;
+	blip_kernel_t* kernel;
 	int const width;
 	int kernel_unit;
 	
-	void adjust_impulse();
-	void rescale_kernel( int shift );
-	int impulses_size() const { return blip_res / 2 * width; }
+	void set_kernel( blip_kernel_t* );
 };
 
 class blip_buffer_state_t
@@ -129,7 +148,7 @@ class blip_buffer_state_t
 
 inline Blip_Buffer_::delta_t* Blip_Buffer_::delta_at( fixed_t f )
 {
-	assert( (f >> fixed_bits) < (unsigned) buffer_size_ );
+	assert( (f >> fixed_bits) < (fixed_t) buffer_size_ );
 	return buffer_center_ + (f >> fixed_bits);
 }
 
@@ -69,12 +69,30 @@ int const blip_reader_idx_factor = sizeof (Blip_Buffer::delta_t);
 #define BLIP_CLAMP( sample, out )\
 	{ if ( BLIP_CLAMP_( (sample) ) ) (out) = ((sample) >> 31) ^ 0x7FFF; }
 
+//// BLIP_SSE2, BLIP_NEON
+
+// Vector instruction set that is always available on target, selected at compile time.
+// Define BLIP_NO_SIMD to use only the portable code.
+#if !defined (BLIP_NO_SIMD)
+	#if defined (__SSE2__) || defined (_M_X64) || (defined (_M_IX86_FP) && _M_IX86_FP >= 2)
+		#define BLIP_SSE2 1
+	#elif defined (__ARM_NEON) || defined (__ARM_NEON__) || defined (_M_ARM64)
+		#define BLIP_NEON 1
+	#endif
+#endif
+
+#if BLIP_SSE2
+	#include <emmintrin.h>
+#elif BLIP_NEON
+	#include <arm_neon.h>
+#endif
+
 
 //// Blip_Synth
 
-// (in >> sh & mask) * mul
+// (in >> sh & mask) * mul, for unsigned in
 #define BLIP_SH_AND_MUL( in, sh, mask, mul ) \
-((int) (in) / ((1U << (sh)) / (mul)) & (unsigned) ((mask) * (mul)))
+((unsigned) ((in) / ((1U << (sh)) / (mul))) & (unsigned) ((mask) * (mul)))
 
 // (T*) ptr + (off >> sh)
 #define BLIP_PTR_OFF_SH( T, ptr, off, sh ) \
@@ -120,7 +138,7 @@ inline void Blip_Synth<quality,range>::offset_resampled( blip_resampled_time_t t
 	int const fwd = -quality / 2;
 	int const rev = fwd + quality - 2;
 	
-	coeff_t const* __restrict imp = (coeff_t const*) ((char const*) phases + phase);
+	coeff_t const* __restrict imp = (coeff_t const*) ((char const*) impl.phases + phase);
 	int const phase2 = phase + phase - (blip_res - 1) * half_width * sizeof (coeff_t);
 	
 	#define BLIP_MID_IMP imp = (coeff_t const*) ((char const*) imp - phase2);
@@ -224,6 +242,131 @@ inline void Blip_Synth<quality,range>::offset_resampled( blip_resampled_time_t t
 #endif
 }
 
+#if (BLIP_SSE2 || BLIP_NEON) && !BLIP_BUFFER_FAST
+	#define BLIP_BATCH_SIMD 1
+#endif
+
+#if BLIP_SSE2 && BLIP_BATCH_SIMD
+	// Reverses order of four 16-bit elements in low half
+	#define BLIP_REV4( v ) _mm_shufflelo_epi16( v, _MM_SHUFFLE( 0, 1, 2, 3 ) )
+	
+	// buf [0 to 7] += kernel [0 to 7] * delta, using 32-bit multiply built from 16-bit ones
+	#define BLIP_MUL_ADD8( buf, kernel ) {\
+		__m128i lo = _mm_mullo_epi16( kernel, delta_lo );\
+		__m128i hi = _mm_add_epi16( _mm_mulhi_epi16( kernel, delta_lo ),\
+				_mm_mullo_epi16( kernel, delta_hi ) );\
+		__m128i* p = (__m128i*) (buf);\
+		_mm_storeu_si128( p    , _mm_add_epi32( _mm_loadu_si128( p     ), _mm_unpacklo_epi16( lo, hi ) ) );\
+		_mm_storeu_si128( p + 1, _mm_add_epi32( _mm_loadu_si128( p + 1 ), _mm_unpackhi_epi16( lo, hi ) ) );\
+	}
+#elif BLIP_NEON && BLIP_BATCH_SIMD
+	// buf [0 to 3] += kernel [0 to 3] * delta
+	#define BLIP_MUL_ADD4( buf, kernel ) \
+		vst1q_s32( buf, vmlaq_s32( vld1q_s32( buf ), vmovl_s16( kernel ), delta_v ) )
+#endif
+
+template<int quality,int range>
+void Blip_Synth<quality,range>::offset_resampled_batch( blip_resampled_time_t const time [],
+		int const delta [], int count, Blip_Buffer* blip_buf ) const
+{
+#if BLIP_BATCH_SIMD
+	// Full kernel is left half for phase, followed by reversed left half for mirror phase.
+	// Products are exact 32-bit ones so this matches offset_resampled() bit for bit.
+	if ( quality == 8 || quality == 12 || quality == 16 )
+	{
+		int const half_width = quality / 2;
+		int const phase_shift = BLIP_BUFFER_ACCURACY - BLIP_PHASE_BITS;
+		for ( int i = 0; i < count; i++ )
+		{
+			Blip_Buffer::delta_t* __restrict buf = blip_buf->delta_at( time [i] ) - half_width;
+			int const d = delta [i] * impl.delta_factor;
+			int const phase = (int) (time [i] >> phase_shift) & (blip_res - 1);
+			coeff_t const* imp  = impl.phases + phase * half_width;
+			coeff_t const* imp2 = impl.phases + (blip_res - 1 - phase) * half_width;
+			
+		#if BLIP_SSE2
+			// delta = hi * 0x10000 + lo, with lo signed
+			__m128i const delta_lo = _mm_set1_epi16( (short) d );
+			__m128i const delta_hi = _mm_set1_epi16( (short) ((d - (short) d) >> 16) );
+			if ( quality == 8 )
+			{
+				__m128i k = _mm_unpacklo_epi64( _mm_loadl_epi64( (__m128i const*) imp ),
+						BLIP_REV4( _mm_loadl_epi64( (__m128i const*) imp2 ) ) );
+				BLIP_MUL_ADD8( buf, k );
+			}
+			else if ( quality == 12 )
+			{
+				__m128i k = _mm_loadl_epi64( (__m128i const*) imp );
+				k = _mm_insert_epi16( k, imp  [4], 4 );
+				k = _mm_insert_epi16( k, imp  [5], 5 );
+				k = _mm_insert_epi16( k, imp2 [5], 6 );
+				k = _mm_insert_epi16( k, imp2 [4], 7 );
+				BLIP_MUL_ADD8( buf, k );
+				
+				// last four
+				__m128i r = BLIP_REV4( _mm_loadl_epi64( (__m128i const*) imp2 ) );
+				__m128i lo = _mm_mullo_epi16( r, delta_lo );
+				__m128i hi = _mm_add_epi16( _mm_mulhi_epi16( r, delta_lo ), _mm_mullo_epi16( r, delta_hi ) );
+				__m128i* p = (__m128i*) (buf + 8);
+				_mm_storeu_si128( p, _mm_add_epi32( _mm_loadu_si128( p ), _mm_unpacklo_epi16( lo, hi ) ) );
+			}
+			else
+			{
+				__m128i r = _mm_loadu_si128( (__m128i const*) imp2 );
+				r = BLIP_REV4( _mm_shuffle_epi32( r, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+				r = _mm_shufflehi_epi16( r, _MM_SHUFFLE( 0, 1, 2, 3 ) );
+				BLIP_MUL_ADD8( buf    , _mm_loadu_si128( (__m128i const*) imp ) );
+				BLIP_MUL_ADD8( buf + 8, r );
+			}
+		#else
+			int32x4_t const delta_v = vdupq_n_s32( d );
+			if ( quality == 8 )
+			{
+				BLIP_MUL_ADD4( buf    , vld1_s16( imp ) );
+				BLIP_MUL_ADD4( buf + 4, vrev64_s16( vld1_s16( imp2 ) ) );
+			}
+			else if ( quality == 12 )
+			{
+				coeff_t const mid [4] = { imp [4], imp [5], imp2 [5], imp2 [4] };
+				BLIP_MUL_ADD4( buf    , vld1_s16( imp ) );
+				BLIP_MUL_ADD4( buf + 4, vld1_s16( mid ) );
+				BLIP_MUL_ADD4( buf + 8, vrev64_s16( vld1_s16( imp2 ) ) );
+			}
+			else
+			{
+				BLIP_MUL_ADD4( buf     , vld1_s16( imp      ) );
+				BLIP_MUL_ADD4( buf +  4, vld1_s16( imp  + 4 ) );
+				BLIP_MUL_ADD4( buf +  8, vrev64_s16( vld1_s16( imp2 + 4 ) ) );
+				BLIP_MUL_ADD4( buf + 12, vrev64_s16( vld1_s16( imp2     ) ) );
+			}
+		#endif
+		}
+		return;
+	}
+#endif
+	
+	for ( int i = 0; i < count; i++ )
+		offset_resampled( time [i], delta [i], blip_buf );
+}
+
+template<int quality,int range>
+void Blip_Synth<quality,range>::offset_batch( blip_time_t const t [], int const delta [],
+		int count, Blip_Buffer* buf ) const
+{
+	// convert in small groups so that times stay on stack
+	blip_resampled_time_t time [64];
+	while ( count > 0 )
+	{
+		int n = count < 64 ? count : 64;
+		for ( int i = 0; i < n; i++ )
+			time [i] = buf->to_fixed( t [i] );
+		offset_resampled_batch( time, delta, n, buf );
+		t     += n;
+		delta += n;
+		count -= n;
+	}
+}
+
 template<int quality,int range>
 #if BLIP_BUFFER_FAST
 	inline
@@ -260,7 +403,7 @@ inline int  Blip_Buffer::samples_avail() const  { return (int) (offset_ >> BLIP_
 inline int  Blip_Buffer::sample_rate() const    { return sample_rate_; }
 inline int  Blip_Buffer::output_latency() const { return BLIP_MAX_QUALITY / 2; }
 inline int  Blip_Buffer::clock_rate() const     { return clock_rate_; }
-inline void Blip_Buffer::clock_rate( int cps )  { factor_ = clock_rate_factor( clock_rate_ = cps ); }
+inline double Blip_Buffer::rate_adjustment() const { return rate_adjustment_; }
 
 inline void Blip_Buffer::remove_silence( int count )
 {
@@ -0,0 +1,214 @@
+// Default Blip_Synth kernels, precomputed to avoid generating them at run time
+
+// These are the output of blip_kernel_t::generate() for blip_eq_t( -8.0 ) (the eq used
+// until treble_eq() is called) with BLIP_PHASE_BITS of 6, for qualities 8, 12 and 16.
+// Each line is the left half of one phase. To regenerate or check them after changing
+// kernel generation, define BLIP_NO_KERNEL_TABLES and dump phases of a synth using
+// that eq.
+
+#ifndef BLIP_BUFFER_KERNELS_H
+#define BLIP_BUFFER_KERNELS_H
+
+static short const blip_default_kernel_8 [blip_res / 2 * 8] = {
+	     0,  -128, -7741,-16801,
+	    -3,   -97, -7544,-16794,
+	    -6,   -68, -7347,-16782,
+	    -8,   -42, -7151,-16765,
+	   -11,   -16, -6957,-16742,
+	   -13,     7, -6765,-16712,
+	   -15,    28, -6574,-16677,
+	   -17,    48, -6385,-16636,
+	   -19,    67, -6198,-16589,
+	   -21,    84, -6013,-16537,
+	   -22,    98, -5829,-16479,
+	   -24,   113, -5649,-16415,
+	   -25,   125, -5470,-16346,
+	   -26,   136, -5293,-16272,
+	   -27,   146, -5119,-16192,
+	   -28,   155, -4948,-16106,
+	   -29,   162, -4778,-16015,
+	   -29,   168, -4612,-15919,
+	   -30,   174, -4448,-15818,
+	   -30,   178, -4287,-15712,
+	   -31,   182, -4128,-15602,
+	   -31,   185, -3974,-15485,
+	   -31,   186, -3820,-15365,
+	   -31,   187, -3671,-15240,
+	   -31,   188, -3525,-15110,
+	   -31,   188, -3381,-14976,
+	   -31,   187, -3240,-14838,
+	   -30,   185, -3103,-14695,
+	   -30,   183, -2968,-14549,
+	   -30,   181, -2837,-14398,
+	   -29,   177, -2708,-14244,
+	   -29,   174, -2583,-14086,
+	   -28,   170, -2462,-13924,
+	   -28,   166, -2342,-13760,
+	   -27,   161, -2227,-13591,
+	   -26,   156, -2114,-13420,
+	   -26,   152, -2005,-13246,
+	   -25,   146, -1899,-13068,
+	   -24,   141, -1796,-12889,
+	   -23,   135, -1696,-12706,
+	   -23,   130, -1599,-12521,
+	   -22,   124, -1506,-12334,
+	   -21,   118, -1415,-12145,
+	   -20,   112, -1328,-11953,
+	   -19,   106, -1243,-11761,
+	   -18,   100, -1162,-11566,
+	   -17,    93, -1083,-11369,
+	   -16,    87, -1007,-11172,
+	   -15,    81,  -934,-10973,
+	   -15,    76,  -864,-10773,
+	   -14,    70,  -797,-10572,
+	   -13,    65,  -734,-10370,
+	   -12,    59,  -672,-10168,
+	   -11,    53,  -613, -9965,
+	   -10,    48,  -557, -9762,
+	    -9,    42,  -503, -9559,
+	    -8,    37,  -452, -9355,
+	    -7,    32,  -404, -9151,
+	    -6,    27,  -357, -8949,
+	    -5,    22,  -313, -8746,
+	    -4,    17,  -272, -8543,
+	    -3,    13,  -233, -8342,
+	    -2,     8,  -195, -8141,
+	    -1,     4,  -161, -7940,
+};
+
+static short const blip_default_kernel_12 [blip_res / 2 * 12] = {
+	     7,   -18,  -601,   441, -7154,-17879,
+	     6,   -12,  -603,   445, -6926,-17872,
+	     5,    -5,  -605,   447, -6701,-17857,
+	     4,     1,  -605,   447, -6478,-17836,
+	     2,     8,  -605,   444, -6256,-17808,
+	     1,    13,  -604,   440, -6037,-17772,
+	     0,    18,  -602,   434, -5820,-17731,
+	    -1,    23,  -599,   426, -5607,-17681,
+	    -2,    28,  -596,   416, -5396,-17625,
+	    -3,    32,  -592,   405, -5188,-17561,
+	    -3,    36,  -588,   392, -4982,-17492,
+	    -4,    40,  -583,   377, -4779,-17416,
+	    -5,    43,  -576,   361, -4580,-17332,
+	    -6,    47,  -570,   344, -4385,-17242,
+	    -6,    49,  -563,   326, -4192,-17146,
+	    -7,    52,  -555,   307, -4004,-17043,
+	    -8,    55,  -548,   287, -3818,-16933,
+	    -8,    57,  -539,   265, -3636,-16818,
+	    -9,    59,  -530,   244, -3458,-16697,
+	    -9,    60,  -520,   221, -3284,-16569,
+	   -10,    62,  -510,   197, -3113,-16436,
+	   -10,    63,  -500,   174, -2947,-16297,
+	   -10,    64,  -490,   149, -2784,-16152,
+	   -11,    65,  -479,   125, -2625,-16002,
+	   -11,    66,  -468,    99, -2470,-15847,
+	   -11,    66,  -456,    74, -2321,-15685,
+	   -11,    66,  -444,    48, -2174,-15520,
+	   -11,    66,  -433,    23, -2032,-15349,
+	   -11,    66,  -421,    -3, -1894,-15173,
+	   -11,    65,  -408,   -29, -1760,-14993,
+	   -11,    65,  -395,   -56, -1630,-14808,
+	   -11,    64,  -382,   -81, -1505,-14619,
+	   -11,    63,  -369,  -107, -1383,-14427,
+	   -11,    62,  -356,  -132, -1267,-14229,
+	   -11,    62,  -344,  -157, -1154,-14028,
+	   -11,    61,  -331,  -181, -1046,-13824,
+	   -11,    59,  -318,  -205,  -942,-13615,
+	   -11,    58,  -305,  -229,  -842,-13404,
+	   -11,    57,  -292,  -252,  -746,-13191,
+	   -10,    55,  -279,  -276,  -654,-12973,
+	   -10,    53,  -266,  -297,  -567,-12754,
+	   -10,    52,  -254,  -319,  -483,-12531,
+	   -10,    51,  -242,  -340,  -403,-12307,
+	    -9,    48,  -229,  -360,  -328,-12080,
+	    -9,    46,  -216,  -380,  -256,-11852,
+	    -9,    45,  -204,  -399,  -189,-11621,
+	    -8,    42,  -192,  -417,  -125,-11389,
+	    -8,    41,  -180,  -435,   -65,-11156,
+	    -8,    39,  -168,  -452,    -9,-10920,
+	    -7,    37,  -158,  -467,    44,-10685,
+	    -7,    35,  -146,  -482,    92,-10448,
+	    -6,    32,  -135,  -496,   138,-10212,
+	    -6,    31,  -125,  -509,   180, -9974,
+	    -6,    29,  -114,  -522,   219, -9737,
+	    -5,    27,  -104,  -534,   254, -9499,
+	    -5,    25,   -94,  -544,   285, -9260,
+	    -4,    23,   -85,  -554,   314, -9023,
+	    -4,    21,   -75,  -563,   340, -8786,
+	    -3,    18,   -66,  -570,   362, -8550,
+	    -3,    17,   -57,  -578,   382, -8314,
+	    -2,    15,   -49,  -585,   400, -8080,
+	    -2,    13,   -41,  -589,   413, -7846,
+	    -1,    11,   -33,  -595,   426, -7614,
+	    -1,     9,   -25,  -598,   434, -7383,
+};
+
+static short const blip_default_kernel_16 [blip_res / 2 * 16] = {
+	    -5,    12,  -163,   231,  -967,   388, -6452,-18613,
+	    -6,    14,  -165,   233,  -953,   366, -6206,-18605,
+	    -6,    16,  -167,   234,  -937,   341, -5964,-18588,
+	    -7,    18,  -168,   235,  -921,   315, -5725,-18563,
+	    -7,    20,  -170,   235,  -904,   288, -5489,-18530,
+	    -8,    22,  -171,   235,  -886,   259, -5257,-18489,
+	    -8,    24,  -172,   234,  -867,   227, -5027,-18440,
+	    -9,    26,  -173,   233,  -848,   196, -4802,-18382,
+	    -9,    27,  -173,   230,  -826,   162, -4581,-18315,
+	    -9,    28,  -173,   227,  -805,   128, -4363,-18242,
+	   -10,    30,  -172,   223,  -783,    92, -4149,-18160,
+	   -10,    30,  -171,   220,  -761,    56, -3940,-18070,
+	   -10,    31,  -170,   215,  -737,    19, -3735,-17973,
+	   -11,    33,  -170,   211,  -714,   -18, -3534,-17869,
+	   -11,    33,  -168,   205,  -689,   -56, -3338,-17756,
+	   -11,    34,  -167,   199,  -664,   -95, -3146,-17636,
+	   -11,    34,  -164,   192,  -639,  -133, -2960,-17508,
+	   -11,    34,  -162,   186,  -614,  -172, -2778,-17373,
+	   -12,    36,  -160,   179,  -589,  -211, -2600,-17232,
+	   -12,    36,  -158,   172,  -563,  -249, -2428,-17084,
+	   -12,    36,  -155,   164,  -536,  -289, -2260,-16929,
+	   -12,    36,  -152,   156,  -510,  -327, -2098,-16767,
+	   -12,    36,  -149,   148,  -484,  -365, -1941,-16599,
+	   -12,    35,  -145,   139,  -457,  -403, -1789,-16424,
+	   -12,    35,  -142,   131,  -432,  -440, -1641,-16244,
+	   -12,    35,  -139,   122,  -405,  -477, -1499,-16057,
+	   -12,    35,  -135,   113,  -379,  -513, -1363,-15865,
+	   -12,    34,  -131,   104,  -353,  -548, -1232,-15667,
+	   -12,    34,  -127,    94,  -327,  -583, -1105,-15464,
+	   -11,    32,  -123,    85,  -302,  -616,  -984,-15255,
+	   -11,    32,  -119,    75,  -276,  -649,  -868,-15042,
+	   -11,    31,  -115,    66,  -251,  -681,  -757,-14824,
+	   -11,    31,  -111,    57,  -228,  -710,  -652,-14602,
+	   -11,    30,  -107,    48,  -203,  -740,  -552,-14375,
+	   -11,    29,  -102,    38,  -179,  -769,  -456,-14144,
+	   -10,    28,   -98,    28,  -156,  -795,  -366,-13909,
+	   -10,    27,   -94,    19,  -133,  -821,  -280,-13671,
+	   -10,    26,   -89,    10,  -111,  -846,  -200,-13429,
+	   -10,    25,   -84,     0,   -89,  -869,  -124,-13185,
+	    -9,    24,   -81,    -9,   -67,  -891,   -54,-12936,
+	    -9,    23,   -76,   -18,   -47,  -911,    12,-12686,
+	    -9,    22,   -71,   -27,   -27,  -930,    72,-12432,
+	    -8,    20,   -67,   -35,    -8,  -948,   129,-12177,
+	    -8,    19,   -62,   -44,    11,  -964,   181,-11920,
+	    -8,    18,   -58,   -52,    29,  -978,   228,-11661,
+	    -7,    17,   -54,   -61,    46,  -991,   271,-11400,
+	    -7,    16,   -50,   -68,    63, -1003,   309,-11138,
+	    -7,    15,   -46,   -76,    79, -1013,   344,-10875,
+	    -6,    13,   -41,   -84,    94, -1022,   374,-10610,
+	    -6,    12,   -37,   -91,   108, -1029,   401,-10346,
+	    -6,    11,   -33,   -98,   122, -1034,   422,-10080,
+	    -5,     9,   -29,  -104,   134, -1038,   440, -9815,
+	    -5,     9,   -26,  -111,   147, -1041,   455, -9550,
+	    -4,     7,   -22,  -117,   158, -1043,   467, -9285,
+	    -4,     6,   -18,  -123,   169, -1043,   475, -9021,
+	    -4,     5,   -15,  -127,   178, -1041,   479, -8758,
+	    -3,     3,   -11,  -133,   187, -1038,   480, -8494,
+	    -3,     3,    -9,  -137,   195, -1034,   478, -8232,
+	    -2,     1,    -5,  -142,   202, -1028,   473, -7972,
+	    -2,     0,    -2,  -146,   209, -1021,   465, -7714,
+	    -2,     0,     0,  -150,   215, -1012,   454, -7457,
+	    -1,    -2,     4,  -154,   220, -1003,   442, -7203,
+	    -1,    -3,     7,  -158,   225,  -992,   426, -6950,
+	     0,    -4,     9,  -161,   228,  -980,   408, -6699,
+};
+
+#endif
+
@@ -0,0 +1,426 @@
+#include "Effects_Buffer.h"
+
+/* This module is free software; you can redistribute it and/or modify it
+under the terms of the GNU Lesser General Public License as published by the
+Free Software Foundation; either version 2.1 of the License, or (at your
+option) any later version. This module is distributed in the hope that it will
+be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General
+Public License for more details. You should have received a copy of the GNU
+Lesser General Public License along with this module; if not, write to the Free
+Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301 USA */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+int const stereo = 2;
+
+// Pairs are mixed in blocks of this size, small enough that all of a block's
+// accumulators stay in cache while every buffer is added in
+int const mix_block_size = 64;
+
+int const gain_unit = Blip_Mixer::gain_unit;
+
+Effects_Buffer::Effects_Buffer( int max_bufs_, int echo_size_ ) :
+	Multi_Buffer( stereo ),
+	max_bufs( std::min( max_bufs_, (int) max_max_bufs ) ),
+	echo_size( std::max( echo_size_, 2 ) )
+{
+	assert( max_bufs_ >= 1 );
+
+	config_.enabled   = false;
+	config_.treble    = 0.6f;
+	config_.delay [0] = 120;
+	config_.delay [1] = 122;
+	config_.feedback  = 0.2f;
+
+	chans       = nullptr;
+	bufs        = new buf_t [max_bufs];
+	bufs_size   = 0;
+	clock_rate_ = 0;
+	bass_freq_  = 16;
+	samples_read = 0;
+	memset( gains, 0, sizeof gains );
+
+	echo          = nullptr;
+	echo_pos      = 0;
+	echo_delay [0] = echo_delay [1] = 1;
+	echo_treble   = 0;
+	echo_feedback = 0;
+	echo_low [0]  = echo_low [1] = 0;
+	echo_quiet    = 0;
+	echo_active   = false;
+}
+
+Effects_Buffer::~Effects_Buffer()
+{
+	delete [] bufs;
+	free( chans );
+	free( echo );
+}
+
+int Effects_Buffer::min_delay() const
+{
+	return 1;
+}
+
+int Effects_Buffer::max_delay() const
+{
+	return sample_rate() ? (echo_size - 1) * 1000 / sample_rate() : 0;
+}
+
+std::error_condition Effects_Buffer::set_sample_rate( int rate, int msec )
+{
+	if ( !echo )
+	{
+		echo = (int*) malloc( echo_size * stereo * sizeof *echo );
+		if ( !echo )
+			return std::make_error_condition(std::errc::not_enough_memory);
+	}
+
+	samples_read = 0;
+	for ( int i = 0; i < bufs_size; i++ )
+	{
+		std::error_condition err = bufs [i].set_sample_rate( rate, msec );
+		if ( err )
+			return err;
+	}
+
+	// buffers added later by set_channel_count() use the same length
+	if ( bufs_size )
+		msec = bufs [0].length();
+	std::error_condition err = Multi_Buffer::set_sample_rate( rate, msec );
+	if ( err )
+		return err;
+
+	clear_echo();
+	apply_config();
+	return {};
+}
+
+std::error_condition Effects_Buffer::set_channel_count( int count, int const types [] )
+{
+	assert( count >= 1 );
+
+	void* p = realloc( chans, count * sizeof *chans );
+	if ( !p )
+		return std::make_error_condition(std::errc::not_enough_memory);
+	chans = (chan_t*) p;
+
+	int new_size = std::min( count, max_bufs );
+	if ( sample_rate() )
+	{
+		for ( int i = bufs_size; i < new_size; i++ )
+		{
+			std::error_condition err = bufs [i].set_sample_rate( sample_rate(), length() );
+			if ( err )
+				return err;
+			if ( clock_rate_ )
+				bufs [i].clock_rate( clock_rate_ );
+			bufs [i].bass_freq( bass_freq_ );
+		}
+	}
+	bufs_size = new_size;
+
+	std::error_condition err = Multi_Buffer::set_channel_count( count, types );
+	if ( err )
+		return err;
+
+	for ( int i = 0; i < count; i++ )
+	{
+		chan_t& ch = chans [i];
+		ch.cfg.vol      = 1.0f;
+		ch.cfg.pan      = 0.0f;
+		ch.cfg.surround = false;
+		ch.cfg.echo     = !(types && (types [i] & noise_type));
+		ch.buf          = -1;
+	}
+
+	clear();
+	apply_config();
+	return {};
+}
+
+void Effects_Buffer::clock_rate( int rate )
+{
+	clock_rate_ = rate;
+	for ( int i = 0; i < bufs_size; i++ )
+		bufs [i].clock_rate( rate );
+}
+
+// All buffers are adjusted, so ones put into use later get it too
+void Effects_Buffer::set_rate_adjustment( double r )
+{
+	for ( int i = 0; i < max_bufs; i++ )
+		bufs [i].set_rate_adjustment( r );
+}
+
+void Effects_Buffer::bass_freq( int freq )
+{
+	bass_freq_ = freq;
+	for ( int i = 0; i < bufs_size; i++ )
+		bufs [i].bass_freq( freq );
+}
+
+void Effects_Buffer::clear_echo()
+{
+	if ( echo )
+		memset( echo, 0, echo_size * stereo * sizeof *echo );
+	echo_low [0] = echo_low [1] = 0;
+	echo_quiet  = 0;
+	echo_active = false;
+}
+
+void Effects_Buffer::clear()
+{
+	samples_read = 0;
+	for ( int i = 0; i < bufs_size; i++ )
+		bufs [i].clear();
+	clear_echo();
+}
+
+// Converts volume to buffer gain, limited to what fits in 16 bits
+static int make_gain( float vol )
+{
+	int gain = (int) floor( vol * gain_unit + 0.5f );
+	return std::min( std::max( gain, -0x8000 ), 0x7FFF );
+}
+
+void Effects_Buffer::apply_config()
+{
+	// echo
+	bool const enabled = config_.enabled && echo;
+	echo_treble   = std::min( std::max( (int) (config_.treble   * 0x10000), 0 ), 0x10000 );
+	echo_feedback = std::min( std::max( (int) (config_.feedback * 0x10000), 0 ), 0x10000 );
+	for ( int i = 0; i < stereo; i++ )
+	{
+		int delay = config_.delay [i] * sample_rate() / 1000;
+		echo_delay [i] = std::min( std::max( delay, 1 ), echo_size - 1 );
+	}
+	if ( !enabled )
+		clear_echo();
+
+	// Give each distinct setting its own buffer, then share the closest one
+	// once they run out. Buffers that end up unused keep their old gains so
+	// that anything still in them plays out as before.
+	bool changed = false;
+	int used = 0;
+	for ( int i = 0; i < channel_count(); i++ )
+	{
+		chan_config_t const& cfg = chans [i].cfg;
+		buf_gain_t want;
+		want.vol [0] = make_gain( cfg.vol * std::min( 1.0f - cfg.pan, 1.0f ) );
+		want.vol [1] = make_gain( cfg.vol * std::min( 1.0f + cfg.pan, 1.0f ) );
+		if ( cfg.surround )
+			want.vol [0] = std::min( -want.vol [0], 0x7FFF );
+		want.echo = enabled && cfg.echo;
+
+		int b = 0;
+		while ( b < used && (gains [b].vol [0] != want.vol [0] ||
+				gains [b].vol [1] != want.vol [1] || gains [b].echo != want.echo) )
+			b++;
+
+		if ( b >= used )
+		{
+			if ( used < bufs_size )
+			{
+				b = used++;
+				gains [b] = want;
+			}
+			else
+			{
+				// best fit
+				int best_dist = 0x7FFFFFFF;
+				for ( int n = 0; n < used; n++ )
+				{
+					int dist = abs( gains [n].vol [0] - want.vol [0] ) +
+							abs( gains [n].vol [1] - want.vol [1] );
+					if ( gains [n].echo != want.echo )
+						dist += 0x10000;
+					if ( best_dist > dist )
+					{
+						best_dist = dist;
+						b = n;
+					}
+				}
+			}
+		}
+
+		if ( chans [i].buf != b )
+		{
+			chans [i].buf = b;
+			changed = true;
+		}
+	}
+
+	if ( !enabled )
+	{
+		for ( int b = used; b < bufs_size; b++ )
+			gains [b].echo = false;
+	}
+
+	if ( changed )
+		channels_changed();
+}
+
+Effects_Buffer::channel_t Effects_Buffer::channel( int i )
+{
+	assert( (unsigned) i < (unsigned) channel_count() );
+	channel_t ch;
+	ch.center = ch.left = ch.right = &bufs [chans [i].buf];
+	return ch;
+}
+
+void Effects_Buffer::end_frame( blip_time_t time )
+{
+	for ( int i = 0; i < bufs_size; i++ )
+		bufs [i].end_frame( time );
+}
+
+int Effects_Buffer::samples_avail() const
+{
+	return bufs_size ? (bufs [0].samples_avail() - samples_read) * stereo : 0;
+}
+
+void Effects_Buffer::run_echo( int dry [], int const send [], int count )
+{
+	// Once the whole delay line has been filled with nothing audible, it's
+	// cleared and skipped until a channel with echo makes sound again
+	int const quiet = 1 << Blip_Buffer::delta_bits;
+	bool loud = false;
+
+	int pos = echo_pos;
+	for ( int i = 0; i < count; i++ )
+	{
+		for ( int c = 0; c < stereo; c++ )
+		{
+			int read = pos - echo_delay [c];
+			if ( read < 0 )
+				read += echo_size;
+
+			int low = echo_low [c];
+			low += (int) (((int64_t) echo [read * stereo + c] - low) * echo_treble >> 16);
+			echo_low [c] = low;
+
+			int s = send [i * stereo + c] + (int) ((int64_t) low * echo_feedback >> 16);
+			echo [pos * stereo + c] = s;
+			dry [i * stereo + c] += s;
+
+			loud |= (unsigned) (s + quiet) > (unsigned) (quiet * 2);
+		}
+		if ( ++pos >= echo_size )
+			pos = 0;
+	}
+	echo_pos = pos;
+
+	if ( loud )
+	{
+		echo_quiet = 0;
+	}
+	else if ( (echo_quiet += count) >= echo_size )
+	{
+		clear_echo();
+	}
+}
+
+static void store_block( int const in [], int count, blip_sample_t out [] )
+{
+	Blip_Mixer::raw_to_samples( in, out, count );
+}
+
+static void store_block( int const in [], int count, float out [] )
+{
+	Blip_Buffer::raw_to_float( in, out, count );
+}
+
+template<class T>
+int Effects_Buffer::read_( T out [], int out_size )
+{
+	assert( (out_size & 1) == 0 ); // must read an even number of samples
+	out_size = std::min( out_size, samples_avail() );
+
+	int pair_count = out_size >> 1;
+	if ( pair_count )
+	{
+		// Decide once which buffers need mixing at all. Those without echo go
+		// first, then those with it.
+		Blip_Mixer::input_t inputs [max_max_bufs];
+		int dry_count = 0;
+		int count = 0;
+		for ( int pass = 0; pass < 2; pass++ )
+		{
+			for ( int b = 0; b < bufs_size; b++ )
+			{
+				if ( gains [b].echo == (pass != 0) && bufs [b].non_silent() )
+				{
+					Blip_Mixer::input_t& in = inputs [count++];
+					in.buf = &bufs [b];
+					in.gain [0] = gains [b].vol [0];
+					in.gain [1] = gains [b].vol [1];
+				}
+			}
+			if ( !pass )
+				dry_count = count;
+		}
+		if ( count > dry_count )
+			echo_active = true;
+
+		int dry  [mix_block_size * stereo];
+		int send [mix_block_size * stereo];
+		do
+		{
+			int n = std::min( pair_count, mix_block_size );
+			memset( dry, 0, n * stereo * sizeof *dry );
+			if ( echo_active )
+			{
+				memset( send, 0, n * stereo * sizeof *send );
+				Blip_Mixer::mix_raw( inputs, dry_count, samples_read, dry, n );
+				Blip_Mixer::mix_raw( inputs + dry_count, count - dry_count, samples_read, send, n );
+				run_echo( dry, send, n );
+			}
+			else
+			{
+				Blip_Mixer::mix_raw( inputs, count, samples_read, dry, n );
+			}
+			store_block( dry, n * stereo, out );
+
+			samples_read += n;
+			out          += n * stereo;
+			pair_count   -= n;
+		}
+		while ( pair_count );
+
+		remove_read_samples();
+	}
+	return out_size;
+}
+
+int Effects_Buffer::read_samples( blip_sample_t out [], int out_size )
+{
+	return read_( out, out_size );
+}
+
+int Effects_Buffer::read_samples_float( float out [], int out_size )
+{
+	return read_( out, out_size );
+}
+
+void Effects_Buffer::remove_read_samples()
+{
+	if ( samples_avail() <= 0 || immediate_removal() )
+	{
+		for ( int i = 0; i < bufs_size; i++ )
+		{
+			buf_t& b = bufs [i];
+			if ( !b.non_silent() )
+				b.remove_silence( samples_read );
+			else
+				b.remove_samples( samples_read );
+		}
+		samples_read = 0;
+	}
+}
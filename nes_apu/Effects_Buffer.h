@@ -0,0 +1,105 @@
+// Multi-channel effects buffer with panning, echo, and surround for each channel
+#pragma once
+
+#include "Multi_Buffer.h"
+
+// Uses a separate buffer for each group of channels with the same settings,
+// and mixes them all to stereo in one pass, skipping any that are silent.
+// Call set_channel_count() before using channels.
+class Effects_Buffer : public Multi_Buffer {
+public:
+	// To reduce memory usage, fewer buffers can be used (channels that don't get
+	// their own use the closest match), and maximum echo delay can be reduced
+	Effects_Buffer( int max_bufs = 32, int echo_size = 24 * 1024 );
+
+	struct pan_vol_t
+	{
+		float vol; // 0.0 = silent, 0.5 = half volume, 1.0 = normal, 2.0 = maximum
+		float pan; // -1.0 = left, 0.0 = center, +1.0 = right
+	};
+
+	// Global configuration
+	struct config_t
+	{
+		bool enabled; // false = no echo
+
+		// Channels with echo are repeated at adjustable left/right delay,
+		// with reduced treble and volume (feedback)
+		float treble;   // 1.0 = full treble, 0.1 = very little, 0.0 = silent
+		int delay [2];  // left, right delays (msec)
+		float feedback; // 0.0 = no echo, 0.5 = each echo half previous, 1.0 = cacophony
+	};
+	config_t& config()                          { return config_; }
+
+	// Limits of delay (msec)
+	int min_delay() const;
+	int max_delay() const;
+
+	// Per-channel configuration. Channels with matching settings share a buffer.
+	// Channels whose type includes noise_type default to no echo.
+	struct chan_config_t : pan_vol_t
+	{
+		bool surround;  // true = negates left volume to put sound in back
+		bool echo;      // false = channel doesn't have any echo
+	};
+	chan_config_t& chan_config( int i )         { return chans [i].cfg; }
+
+	// Applies any changes made to config() and chan_config()
+	void apply_config();
+
+// Implementation
+public:
+	~Effects_Buffer();
+	virtual std::error_condition set_sample_rate( int, int msec = blip_default_length );
+	virtual std::error_condition set_channel_count( int, int const types [] = nullptr );
+	virtual void clock_rate( int );
+	virtual void set_rate_adjustment( double );
+	virtual void bass_freq( int );
+	virtual void clear();
+	virtual channel_t channel( int );
+	virtual void end_frame( blip_time_t );
+	virtual int samples_avail() const;
+	virtual int read_samples( blip_sample_t [], int );
+	virtual int read_samples_float( float [], int );
+
+	enum { max_max_bufs = 32 };
+
+private:
+	typedef Tracked_Blip_Buffer buf_t;
+
+	struct chan_t {
+		chan_config_t cfg;
+		int buf;
+	};
+
+	struct buf_gain_t {
+		int vol [2]; // left, right; Blip_Mixer::gain_unit = 1.0
+		bool echo;
+	};
+
+	config_t config_;
+	chan_t* chans;
+	buf_t* bufs;
+	buf_gain_t gains [max_max_bufs];
+	int bufs_size;
+	int const max_bufs;
+	int clock_rate_;
+	int bass_freq_;
+	int samples_read;
+
+	// echo delay line, as pairs of raw samples
+	int* echo;
+	int const echo_size;
+	int echo_pos;
+	int echo_delay [2];
+	int echo_treble;    // 0x10000 = 1.0
+	int echo_feedback;  // 0x10000 = 1.0
+	int echo_low [2];
+	int echo_quiet;
+	bool echo_active;
+
+	void clear_echo();
+	void remove_read_samples();
+	void run_echo( int dry [], int const send [], int count );
+	template<class T> int read_( T [], int );
+};
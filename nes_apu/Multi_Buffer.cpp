@@ -12,6 +12,9 @@ License along with this module; if not, write to the Free Software Foundation,
 Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA */
 
 #include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
 
 Multi_Buffer::Multi_Buffer( int spf ) : samples_per_frame_( spf )
 {
@@ -124,6 +127,13 @@ int Tracked_Blip_Buffer::read_samples( blip_sample_t out [], int count )
 	return count;
 }
 
+int Tracked_Blip_Buffer::read_samples_float( float out [], int count )
+{
+	count = Blip_Buffer::read_samples_float( out, count );
+	remove_( count );
+	return count;
+}
+
 // Stereo_Buffer
 
 int const stereo = 2;
@@ -155,6 +165,12 @@ void Stereo_Buffer::clock_rate( int rate )
 		bufs [i].clock_rate( rate );
 }
 
+void Stereo_Buffer::set_rate_adjustment( double r )
+{
+	for ( int i = bufs_size; --i >= 0; )
+		bufs [i].set_rate_adjustment( r );
+}
+
 void Stereo_Buffer::bass_freq( int bass )
 {
 	for ( int i = bufs_size; --i >= 0; )
@@ -183,22 +199,40 @@ int Stereo_Buffer::read_samples( blip_sample_t out [], int out_size )
 	if ( pair_count )
 	{
 		mixer.read_pairs( out, pair_count );
-		
-		if ( samples_avail() <= 0 || immediate_removal() )
+		remove_read_samples();
+	}
+	return out_size;
+}
+
+int Stereo_Buffer::read_samples_float( float out [], int out_size )
+{
+	assert( (out_size & 1) == 0 ); // must read an even number of samples
+	out_size = std::min( out_size, samples_avail() );
+
+	int pair_count = int (out_size >> 1);
+	if ( pair_count )
+	{
+		mixer.read_pairs_float( out, pair_count );
+		remove_read_samples();
+	}
+	return out_size;
+}
+
+void Stereo_Buffer::remove_read_samples()
+{
+	if ( samples_avail() <= 0 || immediate_removal() )
+	{
+		for ( int i = bufs_size; --i >= 0; )
 		{
-			for ( int i = bufs_size; --i >= 0; )
-			{
-				buf_t& b = bufs [i];
-				// TODO: might miss non-silence settling since it checks END of last read
-				if ( !b.non_silent() )
-					b.remove_silence( mixer.samples_read );
-				else
-					b.remove_samples( mixer.samples_read );
-			}
-			mixer.samples_read = 0;
+			buf_t& b = bufs [i];
+			// TODO: might miss non-silence settling since it checks END of last read
+			if ( !b.non_silent() )
+				b.remove_silence( mixer.samples_read );
+			else
+				b.remove_samples( mixer.samples_read );
 		}
+		mixer.samples_read = 0;
 	}
-	return out_size;
 }
 
 
@@ -291,3 +325,562 @@ void Stereo_Mixer::mix_stereo( blip_sample_t out_ [], int count )
 		break;
 	}
 }
+
+void Stereo_Mixer::read_pairs_float( float out [], int count )
+{
+	samples_read += count;
+	if ( bufs [0]->non_silent() | bufs [1]->non_silent() )
+		mix_stereo_float( out, count );
+	else
+		mix_mono_float( out, count );
+}
+
+// float mixers run the integrators into a block of raw sample pairs, then convert it all at once
+int const float_block_size = 64;
+
+void Stereo_Mixer::mix_mono_float( float out [], int count )
+{
+	int const bass = bufs [2]->highpass_shift();
+	Blip_Buffer::delta_t const* center = bufs [2]->read_pos() + samples_read - count;
+	int center_sum = bufs [2]->integrator();
+	
+	int raw [float_block_size * stereo];
+	while ( count > 0 )
+	{
+		int n = std::min( count, float_block_size );
+		for ( int i = 0; i < n; i++ )
+		{
+			raw [i * stereo    ] = center_sum;
+			raw [i * stereo + 1] = center_sum;
+			
+			center_sum -= center_sum >> bass;
+			center_sum += center [i];
+		}
+		Blip_Buffer::raw_to_float( raw, out, n * stereo );
+		center += n;
+		out    += n * stereo;
+		count  -= n;
+	}
+	
+	bufs [2]->set_integrator( center_sum );
+}
+
+void Stereo_Mixer::mix_stereo_float( float out [], int count )
+{
+	int const bass = bufs [2]->highpass_shift();
+	Blip_Buffer::delta_t const* left   = bufs [0]->read_pos() + samples_read - count;
+	Blip_Buffer::delta_t const* right  = bufs [1]->read_pos() + samples_read - count;
+	Blip_Buffer::delta_t const* center = bufs [2]->read_pos() + samples_read - count;
+	int left_sum   = bufs [0]->integrator();
+	int right_sum  = bufs [1]->integrator();
+	int center_sum = bufs [2]->integrator();
+	
+	int raw [float_block_size * stereo];
+	while ( count > 0 )
+	{
+		int n = std::min( count, float_block_size );
+		for ( int i = 0; i < n; i++ )
+		{
+			raw [i * stereo    ] = center_sum + left_sum;
+			raw [i * stereo + 1] = center_sum + right_sum;
+			
+			left_sum   -= left_sum   >> bass;
+			right_sum  -= right_sum  >> bass;
+			center_sum -= center_sum >> bass;
+			
+			left_sum   += left   [i];
+			right_sum  += right  [i];
+			center_sum += center [i];
+		}
+		Blip_Buffer::raw_to_float( raw, out, n * stereo );
+		left   += n;
+		right  += n;
+		center += n;
+		out    += n * stereo;
+		count  -= n;
+	}
+	
+	bufs [0]->set_integrator( left_sum );
+	bufs [1]->set_integrator( right_sum );
+	bufs [2]->set_integrator( center_sum );
+}
+
+// Blip_Mixer
+
+// Buffers are mixed from their raw integrators rather than from clamped 16-bit
+// samples. Each product of a raw sample and a gain is under 2^46 and is summed
+// exactly in 64 bits, so results only saturate once, when stored.
+
+int const gain_bits = 14;
+static_assert( 1 << gain_bits == Blip_Mixer::gain_unit, "gain_bits doesn't match gain_unit" );
+
+int const mix_block_size = 256;
+
+// Adds count raw samples from in to pairs in out scaled by left and right gains
+static void mix_gains( int const in [], int count, int left, int right, int64_t out [] )
+{
+	for ( int i = 0; i < count; i++ )
+	{
+		out [i * 2    ] += (int64_t) in [i] * left;
+		out [i * 2 + 1] += (int64_t) in [i] * right;
+	}
+}
+
+// Mixes a single input by integrating it into a block
+static void mix_one( Blip_Mixer::input_t const& in, int offset, int64_t out [], int count )
+{
+	Blip_Buffer& buf = *in.buf;
+	int const bass = buf.highpass_shift();
+	Blip_Buffer::delta_t const* reader = buf.read_pos() + offset;
+	int sum = buf.integrator();
+	
+	int block [mix_block_size];
+	for ( int i = 0; i < count; i++ )
+	{
+		block [i] = sum;
+		sum = (sum + reader [i]) - (sum >> bass);
+	}
+	mix_gains( block, count, in.gain [0], in.gain [1], out );
+	
+	buf.set_integrator( sum );
+}
+
+#if BLIP_SSE2
+
+// Four integrators side by side, with their gains. SSE2 only multiplies unsigned
+// 32-bit values, so each integrator is offset by 2^31 and multiplied by the
+// magnitude of its gain; for a negative gain it's inverted as well. Both leave
+// a constant in each product, which init_quad() adds to bias.
+struct mix_quad_t
+{
+	Blip_Buffer::delta_t const* reader [4];
+	__m128i sum;
+	__m128i flip [stereo];
+	__m128i even [stereo]; // gains of integrators 0 and 2
+	__m128i odd  [stereo]; // gains of integrators 1 and 3
+};
+
+typedef __m128i mix_deltas_t;
+typedef __m128i mix_shift_t;
+typedef __m128i mix_pairs_t;
+
+static void init_quad( mix_quad_t& q, Blip_Mixer::input_t const in [], int offset, int64_t bias [stereo] )
+{
+	int sums [4];
+	for ( int b = 0; b < 4; b++ )
+	{
+		q.reader [b] = in [b].buf->read_pos() + offset;
+		sums     [b] = in [b].buf->integrator();
+	}
+	q.sum = _mm_loadu_si128( (__m128i const*) sums );
+	
+	for ( int c = 0; c < stereo; c++ )
+	{
+		int f [4];
+		int g [4];
+		for ( int b = 0; b < 4; b++ )
+		{
+			int gain = in [b].gain [c];
+			f [b] = (gain < 0) ? INT_MAX : INT_MIN;
+			g [b] = std::abs( gain );
+			bias [c] += (int64_t) g [b] << 31;
+			if ( gain < 0 )
+				bias [c] -= g [b];
+		}
+		q.flip [c] = _mm_set_epi32( f [3], f [2], f [1], f [0] );
+		q.even [c] = _mm_set_epi32( 0, g [2], 0, g [0] );
+		q.odd  [c] = _mm_set_epi32( 0, g [3], 0, g [1] );
+	}
+}
+
+static void finish_quad( mix_quad_t const& q, Blip_Mixer::input_t const in [] )
+{
+	int sums [4];
+	_mm_storeu_si128( (__m128i*) sums, q.sum );
+	for ( int b = 0; b < 4; b++ )
+		in [b].buf->set_integrator( sums [b] );
+}
+
+static inline mix_shift_t mix_shift( int bass )
+{
+	return _mm_cvtsi32_si128( bass );
+}
+
+// Pair sums start at minus the bias
+static inline mix_pairs_t mix_start( int64_t bias )
+{
+	return _mm_set_epi64x( 0, -bias );
+}
+
+// Loads four deltas from each of q's buffers and transposes them so that d [t]
+// holds delta i + t from each
+static inline void load_deltas( mix_quad_t const& q, int i, mix_deltas_t d [4] )
+{
+	__m128i a = _mm_loadu_si128( (__m128i const*) &q.reader [0] [i] );
+	__m128i b = _mm_loadu_si128( (__m128i const*) &q.reader [1] [i] );
+	__m128i c = _mm_loadu_si128( (__m128i const*) &q.reader [2] [i] );
+	__m128i e = _mm_loadu_si128( (__m128i const*) &q.reader [3] [i] );
+	__m128i ab_lo = _mm_unpacklo_epi32( a, b );
+	__m128i ab_hi = _mm_unpackhi_epi32( a, b );
+	__m128i ce_lo = _mm_unpacklo_epi32( c, e );
+	__m128i ce_hi = _mm_unpackhi_epi32( c, e );
+	d [0] = _mm_unpacklo_epi64( ab_lo, ce_lo );
+	d [1] = _mm_unpackhi_epi64( ab_lo, ce_lo );
+	d [2] = _mm_unpacklo_epi64( ab_hi, ce_hi );
+	d [3] = _mm_unpackhi_epi64( ab_hi, ce_hi );
+}
+
+// Adds each of q's integrators times its gains to l and r, then integrates
+// delta. Unless split, left and right gains have the same signs and share a flip.
+template<bool split>
+static inline void mix_step( mix_quad_t& q, mix_deltas_t delta, mix_shift_t shift, mix_pairs_t& l, mix_pairs_t& r )
+{
+	__m128i xl = _mm_xor_si128( q.sum, q.flip [0] );
+	__m128i xr = split ? _mm_xor_si128( q.sum, q.flip [1] ) : xl;
+	l = _mm_add_epi64( l, _mm_add_epi64( _mm_mul_epu32( xl, q.even [0] ),
+			_mm_mul_epu32( _mm_srli_epi64( xl, 32 ), q.odd [0] ) ) );
+	r = _mm_add_epi64( r, _mm_add_epi64( _mm_mul_epu32( xr, q.even [1] ),
+			_mm_mul_epu32( _mm_srli_epi64( xr, 32 ), q.odd [1] ) ) );
+	q.sum = _mm_sub_epi32( _mm_add_epi32( q.sum, delta ), _mm_sra_epi32( q.sum, shift ) );
+}
+
+// Adds the halves of l and r to the pair at out
+static inline void add_pair( int64_t out [stereo], mix_pairs_t l, mix_pairs_t r )
+{
+	__m128i lr = _mm_add_epi64( _mm_unpacklo_epi64( l, r ), _mm_unpackhi_epi64( l, r ) );
+	__m128i* p = (__m128i*) out;
+	_mm_storeu_si128( p, _mm_add_epi64( _mm_loadu_si128( p ), lr ) );
+}
+
+// True if any of the n inputs has left and right gains of opposite signs
+static bool split_signs( Blip_Mixer::input_t const in [], int n )
+{
+	for ( int i = 0; i < n; i++ )
+		if ( (in [i].gain [0] < 0) != (in [i].gain [1] < 0) )
+			return true;
+	return false;
+}
+
+#elif BLIP_NEON
+
+// Four integrators side by side, with their gains
+struct mix_quad_t
+{
+	Blip_Buffer::delta_t const* reader [4];
+	int32x4_t sum;
+	int32x4_t left;
+	int32x4_t right;
+};
+
+typedef int32x4_t mix_deltas_t;
+typedef int32x4_t mix_shift_t;
+typedef int64x2_t mix_pairs_t;
+
+static void init_quad( mix_quad_t& q, Blip_Mixer::input_t const in [], int offset, int64_t [stereo] )
+{
+	int sums [4];
+	int left [4];
+	int right [4];
+	for ( int b = 0; b < 4; b++ )
+	{
+		q.reader [b] = in [b].buf->read_pos() + offset;
+		sums     [b] = in [b].buf->integrator();
+		left     [b] = in [b].gain [0];
+		right    [b] = in [b].gain [1];
+	}
+	q.sum   = vld1q_s32( sums );
+	q.left  = vld1q_s32( left );
+	q.right = vld1q_s32( right );
+}
+
+static void finish_quad( mix_quad_t const& q, Blip_Mixer::input_t const in [] )
+{
+	int sums [4];
+	vst1q_s32( sums, q.sum );
+	for ( int b = 0; b < 4; b++ )
+		in [b].buf->set_integrator( sums [b] );
+}
+
+static inline mix_shift_t mix_shift( int bass )
+{
+	return vdupq_n_s32( -bass );
+}
+
+static inline mix_pairs_t mix_start( int64_t bias )
+{
+	return vsetq_lane_s64( -bias, vdupq_n_s64( 0 ), 0 );
+}
+
+// Loads four deltas from each of q's buffers and transposes them so that d [t]
+// holds delta i + t from each
+static inline void load_deltas( mix_quad_t const& q, int i, mix_deltas_t d [4] )
+{
+	int32x4x2_t ab = vtrnq_s32( vld1q_s32( &q.reader [0] [i] ), vld1q_s32( &q.reader [1] [i] ) );
+	int32x4x2_t ce = vtrnq_s32( vld1q_s32( &q.reader [2] [i] ), vld1q_s32( &q.reader [3] [i] ) );
+	d [0] = vcombine_s32( vget_low_s32 ( ab.val [0] ), vget_low_s32 ( ce.val [0] ) );
+	d [1] = vcombine_s32( vget_low_s32 ( ab.val [1] ), vget_low_s32 ( ce.val [1] ) );
+	d [2] = vcombine_s32( vget_high_s32( ab.val [0] ), vget_high_s32( ce.val [0] ) );
+	d [3] = vcombine_s32( vget_high_s32( ab.val [1] ), vget_high_s32( ce.val [1] ) );
+}
+
+// Adds each of q's integrators times its gains to l and r, then integrates delta
+template<bool split>
+static inline void mix_step( mix_quad_t& q, mix_deltas_t delta, mix_shift_t shift, mix_pairs_t& l, mix_pairs_t& r )
+{
+	l = vmlal_s32( l, vget_low_s32 ( q.sum ), vget_low_s32 ( q.left  ) );
+	r = vmlal_s32( r, vget_low_s32 ( q.sum ), vget_low_s32 ( q.right ) );
+	l = vmlal_s32( l, vget_high_s32( q.sum ), vget_high_s32( q.left  ) );
+	r = vmlal_s32( r, vget_high_s32( q.sum ), vget_high_s32( q.right ) );
+	q.sum = vsubq_s32( vaddq_s32( q.sum, delta ), vshlq_s32( q.sum, shift ) );
+}
+
+// Adds the halves of l and r to the pair at out
+static inline void add_pair( int64_t out [stereo], mix_pairs_t l, mix_pairs_t r )
+{
+	int64x2_t lr = vcombine_s64( vadd_s64( vget_low_s64( l ), vget_high_s64( l ) ),
+			vadd_s64( vget_low_s64( r ), vget_high_s64( r ) ) );
+	vst1q_s64( out, vaddq_s64( vld1q_s64( out ), lr ) );
+}
+
+// Multiplies are signed, so gains of any sign share the same code
+static bool split_signs( Blip_Mixer::input_t const [], int )
+{
+	return false;
+}
+
+#endif
+
+#if BLIP_SSE2 || BLIP_NEON
+
+// Mixes groups of four inputs with the same highpass, each group's integrators
+// side by side in one vector. Deltas are loaded four at a time from each buffer
+// and transposed so that each step adds one delta to every integrator. Doing two
+// groups at once halves the additions to out and keeps more independent
+// integrator steps in flight.
+template<int quads, bool split>
+static void mix_quads( Blip_Mixer::input_t const in [], int offset, int64_t out [], int count )
+{
+	int64_t bias [stereo] = { 0, 0 };
+	mix_quad_t q0, q1;
+	init_quad( q0, &in [0], offset, bias );
+	if ( quads > 1 )
+		init_quad( q1, &in [4], offset, bias );
+	mix_pairs_t const start_l = mix_start( bias [0] );
+	mix_pairs_t const start_r = mix_start( bias [1] );
+	mix_shift_t const shift = mix_shift( in [0].buf->highpass_shift() );
+	
+	int i = 0;
+	for ( ; i + 4 <= count; i += 4 )
+	{
+		mix_pairs_t l0 = start_l, l1 = start_l, l2 = start_l, l3 = start_l;
+		mix_pairs_t r0 = start_r, r1 = start_r, r2 = start_r, r3 = start_r;
+		mix_deltas_t d [4];
+		
+		load_deltas( q0, i, d );
+		mix_step<split>( q0, d [0], shift, l0, r0 );
+		mix_step<split>( q0, d [1], shift, l1, r1 );
+		mix_step<split>( q0, d [2], shift, l2, r2 );
+		mix_step<split>( q0, d [3], shift, l3, r3 );
+		
+		if ( quads > 1 )
+		{
+			load_deltas( q1, i, d );
+			mix_step<split>( q1, d [0], shift, l0, r0 );
+			mix_step<split>( q1, d [1], shift, l1, r1 );
+			mix_step<split>( q1, d [2], shift, l2, r2 );
+			mix_step<split>( q1, d [3], shift, l3, r3 );
+		}
+		
+		add_pair( &out [ i      * stereo], l0, r0 );
+		add_pair( &out [(i + 1) * stereo], l1, r1 );
+		add_pair( &out [(i + 2) * stereo], l2, r2 );
+		add_pair( &out [(i + 3) * stereo], l3, r3 );
+	}
+	
+	finish_quad( q0, &in [0] );
+	if ( quads > 1 )
+		finish_quad( q1, &in [4] );
+	
+	// remaining few samples
+	for ( int b = 0; b < quads * 4; b++ )
+		mix_one( in [b], offset + i, &out [i * stereo], count - i );
+}
+
+template<int quads>
+static void mix_quads( Blip_Mixer::input_t const in [], int offset, int64_t out [], int count )
+{
+	if ( split_signs( in, quads * 4 ) )
+		mix_quads<quads, true >( in, offset, out, count );
+	else
+		mix_quads<quads, false>( in, offset, out, count );
+}
+
+// Number of inputs starting at in that share in [0]'s highpass, up to max
+static int same_bass( Blip_Mixer::input_t const in [], int max )
+{
+	int n = 1;
+	while ( n < max && in [n].buf->highpass_shift() == in [0].buf->highpass_shift() )
+		n++;
+	return n;
+}
+
+#endif
+
+// Adds count pairs mixed from the n inputs, starting offset samples past each
+// buffer's read position, to sums
+static void mix_sums( Blip_Mixer::input_t const in [], int n, int offset, int64_t sums [], int count )
+{
+	int i = 0;
+	#if BLIP_SSE2 || BLIP_NEON
+		while ( i + 4 <= n )
+		{
+			int same = same_bass( &in [i], std::min( n - i, 8 ) );
+			if ( same == 8 )
+			{
+				mix_quads<2>( &in [i], offset, sums, count );
+				i += 8;
+			}
+			else if ( same >= 4 )
+			{
+				mix_quads<1>( &in [i], offset, sums, count );
+				i += 4;
+			}
+			else
+			{
+				mix_one( in [i], offset, sums, count );
+				i++;
+			}
+		}
+	#endif
+	
+	for ( ; i < n; i++ )
+		mix_one( in [i], offset, sums, count );
+}
+
+// Converts count sums to raw samples, saturating at the limits of int
+static void sums_to_raw( int64_t const sums [], int out [], int count )
+{
+	for ( int i = 0; i < count; i++ )
+	{
+		int64_t s = sums [i] >> gain_bits;
+		if ( s != (int) s )
+			s = (s < 0 ? INT_MIN : INT_MAX);
+		out [i] = (int) s;
+	}
+}
+
+void Blip_Mixer::mix_raw( input_t const in [], int n, int offset, int out [], int count )
+{
+	int64_t sums [mix_block_size * stereo];
+	while ( count > 0 )
+	{
+		int const pairs = std::min( count, mix_block_size );
+		int const size  = pairs * stereo;
+		for ( int i = 0; i < size; i++ )
+			sums [i] = (int64_t) out [i] * gain_unit;
+		mix_sums( in, n, offset, sums, pairs );
+		sums_to_raw( sums, out, size );
+		offset += pairs;
+		out    += size;
+		count  -= pairs;
+	}
+}
+
+void Blip_Mixer::raw_to_samples( int const in [], blip_sample_t out [], int count )
+{
+	int i = 0;
+	#if BLIP_SSE2
+		for ( ; i + 8 <= count; i += 8 )
+		{
+			__m128i a = _mm_srai_epi32( _mm_loadu_si128( (__m128i const*) &in [i] ), Blip_Buffer::delta_bits );
+			__m128i b = _mm_srai_epi32( _mm_loadu_si128( (__m128i const*) &in [i + 4] ), Blip_Buffer::delta_bits );
+			_mm_storeu_si128( (__m128i*) &out [i], _mm_packs_epi32( a, b ) );
+		}
+	#elif BLIP_NEON
+		for ( ; i + 4 <= count; i += 4 )
+			vst1_s16( &out [i], vqshrn_n_s32( vld1q_s32( &in [i] ), Blip_Buffer::delta_bits ) );
+	#endif
+	
+	for ( ; i < count; i++ )
+	{
+		int s = in [i] >> Blip_Buffer::delta_bits;
+		BLIP_CLAMP( s, s );
+		out [i] = (blip_sample_t) s;
+	}
+}
+
+// Converts count sums of n inputs to clamped 16-bit samples
+static void store_sums( int64_t const sums [], int n, int count, blip_sample_t out [] )
+{
+	int const shift = gain_bits + Blip_Buffer::delta_bits;
+	int i = 0;
+	#if BLIP_SSE2
+		// Sums of fewer than 2^13 inputs are under 2^59, so shifted right they
+		// fit in the low 32 bits of each and packing them saturates correctly
+		if ( n < 0x2000 )
+		{
+			for ( ; i + 8 <= count; i += 8 )
+			{
+				__m128i const* p = (__m128i const*) &sums [i];
+				__m128i a = _mm_unpacklo_epi64(
+						_mm_shuffle_epi32( _mm_srli_epi64( _mm_loadu_si128( p     ), shift ), 0x08 ),
+						_mm_shuffle_epi32( _mm_srli_epi64( _mm_loadu_si128( p + 1 ), shift ), 0x08 ) );
+				__m128i b = _mm_unpacklo_epi64(
+						_mm_shuffle_epi32( _mm_srli_epi64( _mm_loadu_si128( p + 2 ), shift ), 0x08 ),
+						_mm_shuffle_epi32( _mm_srli_epi64( _mm_loadu_si128( p + 3 ), shift ), 0x08 ) );
+				_mm_storeu_si128( (__m128i*) &out [i], _mm_packs_epi32( a, b ) );
+			}
+		}
+	#elif BLIP_NEON
+		for ( ; i + 4 <= count; i += 4 )
+		{
+			int32x2_t a = vqshrn_n_s64( vld1q_s64( &sums [i    ] ), shift );
+			int32x2_t b = vqshrn_n_s64( vld1q_s64( &sums [i + 2] ), shift );
+			vst1_s16( &out [i], vqmovn_s32( vcombine_s32( a, b ) ) );
+		}
+	#endif
+	
+	for ( ; i < count; i++ )
+	{
+		int64_t s = sums [i] >> shift;
+		if ( s != (blip_sample_t) s )
+			s = (s < 0 ? -0x8000 : 0x7FFF);
+		out [i] = (blip_sample_t) s;
+	}
+}
+
+static void store_sums( int64_t const sums [], int, int count, float out [] )
+{
+	int raw [mix_block_size * stereo];
+	sums_to_raw( sums, raw, count );
+	Blip_Buffer::raw_to_float( raw, out, count );
+}
+
+template<class T>
+static void read_pairs_( Blip_Mixer::input_t const in [], int n, T out [], int count )
+{
+	int64_t sums [mix_block_size * stereo];
+	int offset = 0;
+	while ( offset < count )
+	{
+		int pairs = std::min( count - offset, mix_block_size );
+		memset( sums, 0, pairs * stereo * sizeof sums [0] );
+		mix_sums( in, n, offset, sums, pairs );
+		store_sums( sums, n, pairs * stereo, out );
+		out    += pairs * stereo;
+		offset += pairs;
+	}
+	
+	for ( int i = 0; i < n; i++ )
+		in [i].buf->remove_samples( count );
+}
+
+void Blip_Mixer::read_pairs( input_t const in [], int n, blip_sample_t out [], int count )
+{
+	read_pairs_( in, n, out, count );
+}
+
+void Blip_Mixer::read_pairs_float( input_t const in [], int n, float out [], int count )
+{
+	read_pairs_( in, n, out, count );
+}
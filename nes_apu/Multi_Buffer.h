@@ -40,10 +40,12 @@ public:
 	int sample_rate() const;
 	int length() const;
 	virtual void clock_rate(int);
+	virtual void set_rate_adjustment(double);
 	virtual void bass_freq(int);
 	virtual void clear();
 	virtual void end_frame(blip_time_t);
 	virtual int read_samples(blip_sample_t[], int);
+	virtual int read_samples_float(float[], int);
 	virtual int samples_avail() const;
 
 private:
@@ -83,10 +85,12 @@ public:
 	~Mono_Buffer();
 	virtual std::error_condition set_sample_rate( int rate, int msec = blip_default_length );
 	virtual void clock_rate( int rate )                     { buf.clock_rate( rate ); }
+	virtual void set_rate_adjustment( double r )            { buf.set_rate_adjustment( r ); }
 	virtual void bass_freq( int freq )                      { buf.bass_freq( freq ); }
 	virtual void clear()                                    { buf.clear(); }
 	virtual int samples_avail() const                       { return buf.samples_avail(); }
 	virtual int read_samples( blip_sample_t p [], int s )   { return buf.read_samples( p, s ); }
+	virtual int read_samples_float( float p [], int s )     { return buf.read_samples_float( p, s ); }
 	virtual channel_t channel( int )                        { return chan; }
 	virtual void end_frame( blip_time_t t )                 { buf.end_frame( t ); }
 
@@ -107,6 +111,7 @@ private:
 	// Implementation
 	public:
 		int read_samples( blip_sample_t [], int );
+		int read_samples_float( float [], int );
 		void remove_silence( int );
 		void remove_samples( int );
 		Tracked_Blip_Buffer();
@@ -127,13 +132,49 @@ private:
 		
 		Stereo_Mixer() : samples_read( 0 ) { }
 		void read_pairs( blip_sample_t out [], int count );
+		void read_pairs_float( float out [], int count );
 	
 	private:
 		void mix_mono  ( blip_sample_t out [], int pair_count );
 		void mix_stereo( blip_sample_t out [], int pair_count );
+		void mix_mono_float  ( float out [], int pair_count );
+		void mix_stereo_float( float out [], int pair_count );
 	};
 
 
+// Mixes any number of Blip_Buffers to interleaved stereo in a single pass, each
+// with its own left and right gain. Buffers are integrated four at a time, so
+// mixing many costs much less than reading each separately.
+class Blip_Mixer {
+public:
+	enum { gain_unit = 0x4000 }; // gain of 1.0; gains range from -0x8000 to 0x7FFF
+
+	struct input_t {
+		Blip_Buffer* buf;
+		int gain [2]; // left, right
+	};
+
+	// Mixes count samples from each of n inputs into count stereo pairs, then
+	// removes them from the buffers. Each buffer must have at least count samples
+	// available. Buffers are mixed at full internal resolution, without clamping
+	// each one first; only the final mix is clamped (see mix_raw()).
+	static void read_pairs( input_t const in [], int n, blip_sample_t out [], int count );
+	static void read_pairs_float( input_t const in [], int n, float out [], int count );
+
+// Low-level features
+
+	// Adds count pairs of raw samples (see Blip_Buffer::raw_to_float()) to out,
+	// starting offset samples past each buffer's read position. Advances the
+	// integrators but doesn't remove any samples. Sums are exact whatever the
+	// number of inputs and their gains, and each result saturates at the limits
+	// of int (about +/-4.0 as a float) rather than wrapping.
+	static void mix_raw( input_t const in [], int n, int offset, int out [], int count );
+
+	// Converts n raw samples to clamped 16-bit samples
+	static void raw_to_samples( const int in [], blip_sample_t out [], int n );
+};
+
+
 // Uses three buffers (one for center) and outputs stereo sample pairs.
 class Stereo_Buffer : public Multi_Buffer {
 public:
@@ -149,15 +190,18 @@ public:
 	~Stereo_Buffer();
 	virtual std::error_condition set_sample_rate( int, int msec = blip_default_length );
 	virtual void clock_rate( int );
+	virtual void set_rate_adjustment( double );
 	virtual void bass_freq( int );
 	virtual void clear();
 	virtual channel_t channel( int )            { return chan; }
 	virtual void end_frame( blip_time_t );
 	virtual int samples_avail() const           { return (bufs [0].samples_avail() - mixer.samples_read) * 2; }
 	virtual int read_samples( blip_sample_t [], int );
+	virtual int read_samples_float( float [], int );
 	
 private:
 	enum { bufs_size = 3 };
+	void remove_read_samples();
 	typedef Tracked_Blip_Buffer buf_t;
 	buf_t bufs [bufs_size];
 	Stereo_Mixer mixer;
@@ -173,12 +217,14 @@ public:
 	Silent_Buffer();
 	virtual std::error_condition set_sample_rate( int rate, int msec = blip_default_length );
 	virtual void clock_rate( int )                  { }
+	virtual void set_rate_adjustment( double )      { }
 	virtual void bass_freq( int )                   { }
 	virtual void clear()                            { }
 	virtual channel_t channel( int )                { return chan; }
 	virtual void end_frame( blip_time_t )           { }
 	virtual int samples_avail() const               { return 0; }
 	virtual int read_samples( blip_sample_t [], int ) { return 0; }
+	virtual int read_samples_float( float [], int ) { return 0; }
 };
 
 
@@ -193,10 +239,12 @@ inline int  Multi_Buffer::samples_per_frame() const             { return samples
 inline int  Multi_Buffer::sample_rate() const                   { return sample_rate_; }
 inline int  Multi_Buffer::length() const                        { return length_; }
 inline void Multi_Buffer::clock_rate( int )                     { }
+inline void Multi_Buffer::set_rate_adjustment( double )         { }
 inline void Multi_Buffer::bass_freq( int )                      { }
 inline void Multi_Buffer::clear()                               { }
 inline void Multi_Buffer::end_frame( blip_time_t )              { }
 inline int  Multi_Buffer::read_samples( blip_sample_t [], int ) { return 0; }
+inline int  Multi_Buffer::read_samples_float( float [], int )   { return 0; }
 inline int  Multi_Buffer::samples_avail() const                 { return 0; }
 
 inline std::error_condition Multi_Buffer::set_channel_count( int n, int const types [] )
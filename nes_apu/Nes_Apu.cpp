@@ -13,6 +13,7 @@
    Boston, MA 02110-1301 USA */
 
 #include "Nes_Apu.h"
+#include "Nes_State.h"
 
 int const amp_range = 15;
 
@@ -29,7 +30,23 @@ Nes_Apu::Nes_Apu() :
 	oscs [3] = &noise;
 	oscs [4] = &dmc;
 	
-	set_output( nullptr );
+	// registers are read by update_idle() during the first reset()
+	for ( int i = 0; i < osc_count; i++ )
+	{
+		Nes_Osc& osc = *oscs [i];
+		osc.output = nullptr;
+		osc.length_counter = 0;
+		for ( int r = 0; r < 4; r++ )
+		{
+			osc.regs [r] = 0;
+			osc.reg_written [r] = false;
+		}
+	}
+	last_time = 0;
+	for ( int i = 0; i < lazy_osc_count; i++ )
+		osc_times [i] = 0;
+	idle_oscs = 0;
+	
 	dmc.nonlinear = false;
 	volume( 1.0 );
 	reset( false );
@@ -37,6 +54,7 @@ Nes_Apu::Nes_Apu() :
 
 void Nes_Apu::treble_eq( const blip_eq_t& eq )
 {
+	run_oscs( last_time );
 	square_synth  .treble_eq( eq );
 	triangle.synth.treble_eq( eq );
 	noise   .synth.treble_eq( eq );
@@ -45,6 +63,7 @@ void Nes_Apu::treble_eq( const blip_eq_t& eq )
 
 void Nes_Apu::enable_nonlinear_( double sq, double tnd )
 {
+	run_oscs( last_time );
 	dmc.nonlinear = true;
 	square_synth.volume( sq );
 	
@@ -57,12 +76,14 @@ void Nes_Apu::enable_nonlinear_( double sq, double tnd )
 	triangle.last_amp = 0;
 	noise   .last_amp = 0;
 	dmc     .last_amp = 0;
+	update_idle();
 }
 
 void Nes_Apu::volume( double v )
 {
 	if ( !dmc.nonlinear )
 	{
+		run_oscs( last_time );
 		v *= 1.0 / 1.11; // TODO: merge into values below
 		square_synth  .volume( 0.125 / amp_range * v ); // was 0.1128   1.108
 		triangle.synth.volume( 0.150 / amp_range * v ); // was 0.12765  1.175
@@ -77,6 +98,16 @@ void Nes_Apu::set_output( Blip_Buffer* buffer )
 		set_output( i, buffer );
 }
 
+void Nes_Apu::set_output( int osc, Blip_Buffer* buf )
+{
+	assert( (unsigned) osc < osc_count );
+	if ( osc < lazy_osc_count )
+		run_osc( osc, last_time );
+	oscs [osc]->output = buf;
+	if ( osc < lazy_osc_count )
+		update_idle( osc );
+}
+
 void Nes_Apu::set_tempo( double t )
 {
 	tempo_ = t;
@@ -87,6 +118,7 @@ void Nes_Apu::set_tempo( double t )
 
 void Nes_Apu::reset( bool pal_mode, uint8_t initial_dmc_dac )
 {
+	run_oscs( last_time );
 	dmc.pal_mode = pal_mode;
 	set_tempo( tempo_ );
 	
@@ -98,6 +130,8 @@ void Nes_Apu::reset( bool pal_mode, uint8_t initial_dmc_dac )
 	
 	last_time = 0;
 	last_dmc_time = 0;
+	for ( int i = 0; i < lazy_osc_count; i++ )
+		osc_times [i] = 0;
 	osc_enables = 0;
 	irq_flag = false;
 	enable_w4011 = true;
@@ -114,6 +148,7 @@ void Nes_Apu::reset( bool pal_mode, uint8_t initial_dmc_dac )
 		triangle.last_amp = 15;
 	if ( !dmc.nonlinear ) // TODO: remove?
 		dmc.last_amp = initial_dmc_dac; // prevent output transition
+	update_idle();
 }
 
 void Nes_Apu::irq_changed()
@@ -135,6 +170,51 @@ void Nes_Apu::irq_changed()
 
 // frames
 
+void Nes_Apu::run_osc( int index, blip_time_t time )
+{
+	blip_time_t start = osc_times [index];
+	if ( start < time )
+	{
+		osc_times [index] = time;
+		switch ( index )
+		{
+			case 0: square1 .run( start, time ); break;
+			case 1: square2 .run( start, time ); break;
+			case 2: triangle.run( start, time ); break;
+			case 3: noise   .run( start, time ); break;
+		}
+	}
+}
+
+void Nes_Apu::run_oscs( blip_time_t time )
+{
+	for ( int i = 0; i < lazy_osc_count; i++ )
+		run_osc( i, time );
+}
+
+bool Nes_Apu::osc_idle( int index ) const
+{
+	switch ( index )
+	{
+		case 0:  return square1 .idle();
+		case 1:  return square2 .idle();
+		case 2:  return triangle.idle();
+		default: return noise   .idle();
+	}
+}
+
+void Nes_Apu::update_idle( int index )
+{
+	idle_oscs = (idle_oscs & ~(1 << index)) | osc_idle( index ) << index;
+}
+
+void Nes_Apu::update_idle()
+{
+	idle_oscs = 0;
+	for ( int i = 0; i < lazy_osc_count; i++ )
+		idle_oscs |= osc_idle( i ) << i;
+}
+
 void Nes_Apu::run_until( blip_time_t end_time )
 {
 	assert( end_time >= last_dmc_time );
@@ -146,20 +226,78 @@ void Nes_Apu::run_until( blip_time_t end_time )
 	}
 }
 
-void Nes_Apu::run_until_( blip_time_t end_time )
+inline void Nes_Apu::run_dmc( blip_time_t end_time )
 {
-	assert( end_time >= last_time );
-	
-	if ( end_time == last_time )
-		return;
-	
 	if ( last_dmc_time < end_time )
 	{
 		blip_time_t start = last_dmc_time;
 		last_dmc_time = end_time;
 		dmc.run( start, end_time );
 	}
+}
+
+inline void Nes_Apu::clock_frame( blip_time_t time )
+{
+	// take frame-specific actions
+	frame_delay = frame_period;
+	switch ( frame++ )
+	{
+		case 0:
+			if ( !(frame_mode & 0xC0) ) {
+	 			next_irq = time + frame_period * 4 + 2;
+	 			irq_flag = true;
+	 		}
+	 		// fall through
+	 	case 2:
+	 		// clock length and sweep on frames 0 and 2
+			square1.clock_length( 0x20 );
+			square2.clock_length( 0x20 );
+			noise.clock_length( 0x20 );
+			triangle.clock_length( 0x80 ); // different bit for halt flag on triangle
+			
+			square1.clock_sweep( -1 );
+			square2.clock_sweep( 0 );
+			
+			// frame 2 is slightly shorter in mode 1
+			if ( dmc.pal_mode && frame == 3 )
+				frame_delay -= 2;
+	 		break;
+	 	
+		case 1:
+			// frame 1 is slightly shorter in mode 0
+			if ( !dmc.pal_mode )
+				frame_delay -= 2;
+			break;
+		
+	 	case 3:
+	 		frame = 0;
+	 		
+	 		// frame 3 is almost twice as long in mode 1
+	 		if ( frame_mode & 0x80 )
+				frame_delay += frame_period - (dmc.pal_mode ? 2 : 6);
+			break;
+	}
+	
+	// clock envelopes and linear counter every frame
+	triangle.clock_linear_counter();
+	square1.clock_envelope();
+	square2.clock_envelope();
+	noise.clock_envelope();
+}
+
+void Nes_Apu::run_until_( blip_time_t end_time )
+{
+	assert( end_time >= last_time );
 	
+	if ( end_time == last_time )
+		return;
+	
+	run_dmc( end_time );
+	run_frames( end_time );
+}
+
+void Nes_Apu::run_frames( blip_time_t end_time )
+{
 	while ( true )
 	{
 		// earlier of next frame time or end time
@@ -167,62 +305,20 @@ void Nes_Apu::run_until_( blip_time_t end_time )
 		if ( time > end_time )
 			time = end_time;
 		frame_delay -= time - last_time;
-		
-		// run oscs to present
-		square1.run( last_time, time );
-		square2.run( last_time, time );
-		triangle.run( last_time, time );
-		noise.run( last_time, time );
 		last_time = time;
 		
 		if ( time == end_time )
 			break; // no more frames to run
 		
-		// take frame-specific actions
-		frame_delay = frame_period;
-		switch ( frame++ )
+		// run oscs the frame clock might affect to present
+		for ( int i = 0; i < lazy_osc_count; i++ )
 		{
-			case 0:
-				if ( !(frame_mode & 0xC0) ) {
-		 			next_irq = time + frame_period * 4 + 2;
-		 			irq_flag = true;
-		 		}
-		 		// fall through
-		 	case 2:
-		 		// clock length and sweep on frames 0 and 2
-				square1.clock_length( 0x20 );
-				square2.clock_length( 0x20 );
-				noise.clock_length( 0x20 );
-				triangle.clock_length( 0x80 ); // different bit for halt flag on triangle
-				
-				square1.clock_sweep( -1 );
-				square2.clock_sweep( 0 );
-				
-				// frame 2 is slightly shorter in mode 1
-				if ( dmc.pal_mode && frame == 3 )
-					frame_delay -= 2;
-		 		break;
-		 	
-			case 1:
-				// frame 1 is slightly shorter in mode 0
-				if ( !dmc.pal_mode )
-					frame_delay -= 2;
-				break;
-			
-		 	case 3:
-		 		frame = 0;
-		 		
-		 		// frame 3 is almost twice as long in mode 1
-		 		if ( frame_mode & 0x80 )
-					frame_delay += frame_period - (dmc.pal_mode ? 2 : 6);
-				break;
+			if ( !((idle_oscs >> i) & 1) )
+				run_osc( i, time );
 		}
 		
-		// clock envelopes and linear counter every frame
-		triangle.clock_linear_counter();
-		square1.clock_envelope();
-		square2.clock_envelope();
-		noise.clock_envelope();
+		clock_frame( time );
+		update_idle();
 	}
 }
 
@@ -240,6 +336,7 @@ void Nes_Apu::end_frame( blip_time_t end_time )
 {
 	if ( end_time > last_time )
 		run_until_( end_time );
+	run_oscs( last_time );
 	
 	if ( dmc.nonlinear )
 	{
@@ -250,9 +347,16 @@ void Nes_Apu::end_frame( blip_time_t end_time )
 		zero_apu_osc( &dmc,      last_time );
 	}
 	
-	// make times relative to new frame
+	shift_times( end_time );
+}
+
+// make times relative to new frame
+void Nes_Apu::shift_times( blip_time_t end_time )
+{
 	last_time -= end_time;
 	assert( last_time >= 0 );
+	for ( int i = 0; i < lazy_osc_count; i++ )
+		osc_times [i] = last_time;
 	
 	last_dmc_time -= end_time;
 	assert( last_dmc_time >= 0 );
@@ -272,14 +376,105 @@ void Nes_Apu::end_frame( blip_time_t end_time )
 	}
 }
 
-// registers
+// fast forward
 
-static const unsigned char length_table [0x20] = {
-	0x0A, 0xFE, 0x14, 0x02, 0x28, 0x04, 0x50, 0x06,
-	0xA0, 0x08, 0x3C, 0x0A, 0x0E, 0x0C, 0x1A, 0x0E, 
-	0x0C, 0x10, 0x18, 0x12, 0x30, 0x14, 0x60, 0x16,
-	0xC0, 0x18, 0x48, 0x1A, 0x10, 0x1C, 0x20, 0x1E
-};
+void Nes_Apu::skip_oscs( blip_time_t time )
+{
+	square1 .skip( last_time, time );
+	square2 .skip( last_time, time );
+	triangle.skip( last_time, time );
+	noise   .skip( last_time, time );
+}
+
+// True if frame clocks won't change anything but envelope and sweep dividers,
+// which can then be advanced many frames at once
+bool Nes_Apu::frames_steady() const
+{
+	return square1.length_steady( 0x20 ) && !square1.reg_written [3] && square1.sweep_steady( -1 ) &&
+			square2.length_steady( 0x20 ) && !square2.reg_written [3] && square2.sweep_steady( 0 ) &&
+			noise  .length_steady( 0x20 ) && !noise  .reg_written [3] &&
+			triangle.length_steady( 0x80 ) && triangle.linear_counter_steady();
+}
+
+// Skips whole frame sequences, if steady, starting just before frame 0 is clocked
+void Nes_Apu::skip_frames( blip_time_t end_time )
+{
+	assert( frame == 0 );
+	int sequence = frame_period * 4 - 2;
+	if ( frame_mode & 0x80 )
+		sequence += frame_period - (dmc.pal_mode ? 2 : 6);
+	
+	int count = (end_time - last_time) / sequence;
+	if ( count )
+	{
+		blip_time_t time = last_time + count * sequence;
+		skip_oscs( time );
+		
+		// four frames per sequence, with length and sweep clocked on two
+		square1.skip_envelope( count * 4 );
+		square2.skip_envelope( count * 4 );
+		noise  .skip_envelope( count * 4 );
+		square1.skip_sweep( count * 2 );
+		square2.skip_sweep( count * 2 );
+		
+		if ( !(frame_mode & 0xC0) )
+		{
+			next_irq = last_time + frame_delay + (count - 1) * sequence + frame_period * 4 + 2;
+			irq_flag = true;
+		}
+		last_time = time;
+	}
+}
+
+void Nes_Apu::skip_until( blip_time_t end_time )
+{
+	run_dmc( end_time );
+	
+	while ( true )
+	{
+		blip_time_t time = last_time + frame_delay;
+		if ( time > end_time )
+			time = end_time;
+		skip_oscs( time );
+		frame_delay -= time - last_time;
+		last_time = time;
+		
+		if ( time == end_time )
+			break;
+		
+		clock_frame( time );
+		if ( frame == 0 && frames_steady() )
+			skip_frames( end_time );
+	}
+}
+
+void Nes_Apu::fast_forward( blip_time_t clocks )
+{
+	assert( clocks >= 0 );
+	run_oscs( last_time );
+	
+	Blip_Buffer* const dmc_output = dmc.output;
+	dmc.output = nullptr;
+	
+	// times stay in range by skipping in chunks
+	blip_time_t const max_chunk = 0x10000000;
+	while ( clocks > 0 )
+	{
+		blip_time_t chunk = (clocks < max_chunk ? clocks : max_chunk);
+		clocks -= chunk;
+		
+		blip_time_t start = last_time;
+		skip_until( start + chunk );
+		shift_times( chunk );
+		assert( last_time == start );
+	}
+	
+	dmc.output = dmc_output;
+	update_idle();
+	irq_changed();
+}
+
+// registers
 
 void Nes_Apu::write_register( blip_time_t time, uint16_t addr, uint8_t data )
 {
@@ -290,12 +485,42 @@ void Nes_Apu::write_register( blip_time_t time, uint16_t addr, uint8_t data )
 		return;
 	
 	run_until_( time );
-	
+	write_( time, addr, data );
+}
+
+void Nes_Apu::write_registers( apu_write_t const writes [], size_t count )
+{
+	for ( size_t i = 0; i < count; i++ )
+	{
+		apu_write_t const& w = writes [i];
+		assert( i == 0 || writes [i - 1].time <= w.time ); // must be in time order
+		
+		if ( w.addr < io_addr || w.addr > io_addr + io_size )
+			continue;
+		
+		// While the DMC isn't fetching samples, nothing it does can affect the
+		// other registers, so it's only caught up before writes to its own
+		if ( dmc.length_counter || (unsigned) (w.addr - 0x4010) <= 0x4015 - 0x4010 )
+			run_dmc( w.time );
+		
+		assert( w.time >= last_time );
+		if ( w.time > last_time )
+			run_frames( w.time );
+		
+		write_( w.time, w.addr, w.data );
+	}
+	run_dmc( last_time );
+}
+
+void Nes_Apu::write_( blip_time_t time, uint16_t addr, uint8_t data )
+{
 	if ( addr < 0x4014 )
 	{
 		// Write to channel
 		int osc_index = (addr - io_addr) >> 2;
 		Nes_Osc* osc = oscs [osc_index];
+		if ( osc_index < lazy_osc_count )
+			run_osc( osc_index, time );
 		
 		int reg = addr & 3;
 		osc->regs [reg] = data;
@@ -311,16 +536,19 @@ void Nes_Apu::write_register( blip_time_t time, uint16_t addr, uint8_t data )
 		{
 			// load length counter
 			if ( (osc_enables >> osc_index) & 1 )
-				osc->length_counter = length_table [data >> 3];
+				osc->length_counter = Nes_Apu_Tables::length [data >> 3];
 			
 			// reset square phase
 			if ( osc_index < 2 )
 				((Nes_Square*) osc)->phase = Nes_Square::phase_range - 1;
 		}
+		if ( osc_index < lazy_osc_count )
+			update_idle( osc_index );
 	}
 	else if ( addr == 0x4015 )
 	{
 		// Channel enables
+		run_oscs( time );
 		for ( int i = osc_count; i--; )
 			if ( !((data >> i) & 1) )
 				oscs [i]->length_counter = 0;
@@ -338,6 +566,8 @@ void Nes_Apu::write_register( blip_time_t time, uint16_t addr, uint8_t data )
 			dmc.start(); // dmc just enabled
 		}
 		
+		update_idle();
+		
 		if ( recalc_irq )
 			irq_changed();
 	}
@@ -388,3 +618,73 @@ uint8_t Nes_Apu::read_status( blip_time_t time )
 	
 	return result;
 }
+
+// save states
+
+uint32_t const apu_state_tag = nes_state_tag( "APUR" );
+int const apu_state_version = 1;
+
+void Nes_Apu::save_state( Nes_State_Writer& out ) const
+{
+	out.begin_block( apu_state_tag, apu_state_version );
+	out.write8 ( dmc.pal_mode );
+	out.write32( last_time );
+	out.write32( last_dmc_time );
+	for ( int i = 0; i < lazy_osc_count; i++ )
+		out.write32( osc_times [i] );
+	out.write32( earliest_irq_ );
+	out.write32( next_irq );
+	out.write32( frame_delay );
+	out.write8 ( frame );
+	out.write8 ( osc_enables );
+	out.write8 ( frame_mode );
+	out.write8 ( irq_flag );
+	square1 .save_state( out );
+	square2 .save_state( out );
+	triangle.save_state( out );
+	noise   .save_state( out );
+	dmc     .save_state( out );
+	out.end_block();
+}
+
+std::error_condition Nes_Apu::load_state( Nes_State_Reader& in )
+{
+	bool const pal_mode = dmc.pal_mode;
+	if ( in.begin_block( apu_state_tag, apu_state_version ) )
+	{
+		dmc.pal_mode  = in.read8() != 0;
+		last_time     = in.read32();
+		last_dmc_time = in.read32();
+		for ( int i = 0; i < lazy_osc_count; i++ )
+			osc_times [i] = in.read32();
+		earliest_irq_ = in.read32();
+		next_irq      = in.read32();
+		frame_delay   = in.read32();
+		frame         = in.read8() & 3;
+		osc_enables   = in.read8();
+		frame_mode    = in.read8();
+		irq_flag      = in.read8() != 0;
+		square1 .load_state( in );
+		square2 .load_state( in );
+		triangle.load_state( in );
+		noise   .load_state( in );
+		dmc     .load_state( in );
+		in.end_block();
+	}
+	
+	if ( in.error() )
+	{
+		// times may be garbage, so keep reset() from running oscillators
+		last_time = 0;
+		for ( int i = 0; i < lazy_osc_count; i++ )
+			osc_times [i] = 0;
+		reset( pal_mode );
+		return in.error();
+	}
+	
+	set_tempo( tempo_ ); // frame period depends on PAL mode
+	update_idle();
+	if ( irq_notifier )
+		irq_notifier();
+	return {};
+}
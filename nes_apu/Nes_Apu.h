@@ -6,7 +6,7 @@
 #include <functional>
 #include <climits>
 
-struct apu_state_t;
+struct apu_snapshot_t;
 class Nes_Buffer;
 
 class DLLEXPORT Nes_Apu : public Nes_Apu_Base {
@@ -28,6 +28,10 @@ public:
 	enum { io_size = 0x18 };
 	void write_register( nes_time_t, uint16_t addr, uint8_t data );
 	
+	// Same as calling write_register() for each of count writes, which must be
+	// in time order, but with less overhead
+	void write_registers( apu_write_t const [], size_t count );
+	
 	// Reads from status register (0x4015)
 	enum { status_addr = 0x4015 };
 	uint8_t read_status( nes_time_t );
@@ -37,6 +41,12 @@ public:
 	// and each can be whatever length is convenient.
 	void end_frame( nes_time_t ) override;
 	
+	// Advances emulation by the given number of clocks without generating any
+	// sound, in much less time than running it muted. Times in the current
+	// frame are unaffected, so emulation continues from the same point in it.
+	// DMC samples play silently and still read memory as they go.
+	void fast_forward( nes_time_t clocks );
+	
 // Optional
 
 	// Resets internal frame counter, registers, and all oscillators.
@@ -53,9 +63,17 @@ public:
 	// Adjusts frame period
 	void set_tempo( double );
 	
-	// Saves/loads exact emulation state
-	void save_state( apu_state_t* out ) const;
-	void load_state( apu_state_t const& );
+	// Saves/loads exact emulation state in portable format (see Nes_State.h).
+	// State can be saved at any time in a frame, and emulation continues from
+	// the same point after loading it. Loading a bad state resets the APU and
+	// returns an error.
+	void save_state( Nes_State_Writer& ) const;
+	std::error_condition load_state( Nes_State_Reader& );
+	
+	// Saves/loads registers and oscillators in the fixed-size format of
+	// apu_snapshot.h. Only valid at the beginning of a time frame.
+	void save_snapshot( apu_snapshot_t* ) const;
+	void load_snapshot( apu_snapshot_t const& );
 	
 	// Sets overall volume (default is 1.0)
 	void volume( double ) override;
@@ -148,17 +166,31 @@ private:
 #pragma warning(pop)
 #endif
 
+	// Squares, triangle, and noise are only run when something is about to
+	// change them, and idle ones aren't run for frame sequencer clocks.
+	enum { lazy_osc_count = 4 };
+	nes_time_t osc_times [lazy_osc_count]; // time each has been run until
+	int idle_oscs; // bit set for each one that can't change until a register write
+
 	void irq_changed();
 	void state_restored();
 	void run_until_( nes_time_t );
+	void run_dmc( nes_time_t );
+	void run_frames( nes_time_t );
+	void clock_frame( nes_time_t );
+	void skip_oscs( nes_time_t );
+	void skip_until( nes_time_t );
+	bool frames_steady() const;
+	void skip_frames( nes_time_t );
+	void shift_times( nes_time_t );
+	void write_( nes_time_t, uint16_t addr, uint8_t data );
+	void run_osc( int index, nes_time_t );
+	void run_oscs( nes_time_t );
+	bool osc_idle( int index ) const;
+	void update_idle( int index );
+	void update_idle();
 };
 
-inline void Nes_Apu::set_output( int osc, Blip_Buffer* buf )
-{
-	assert( (unsigned) osc < osc_count );
-	oscs [osc]->output = buf;
-}
-
 inline Nes_Apu::nes_time_t Nes_Apu::earliest_irq( nes_time_t ) const
 {
 	return earliest_irq_;
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Blip_Buffer.h"
+#include <cstddef>
 
 class DLLEXPORT Nes_Apu_Base
 {
@@ -23,3 +24,10 @@ public:
 protected:
 	Nes_Apu_Base() = default;
 };
+
+// Register write for the chips' write_registers(), which take them in batches
+struct apu_write_t {
+	Nes_Apu_Base::nes_time_t time;
+	uint16_t addr;
+	uint8_t data;
+};
@@ -0,0 +1,181 @@
+#include "Nes_Buffer.h"
+
+#include "Nes_Apu.h"
+
+/* This module is free software; you can redistribute it and/or modify it
+under the terms of the GNU Lesser General Public License as published by the
+Free Software Foundation; either version 2.1 of the License, or (at your
+option) any later version. This module is distributed in the hope that it will
+be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General
+Public License for more details. You should have received a copy of the GNU
+Lesser General Public License along with this module; if not, write to the Free
+Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301 USA */
+
+#include <algorithm>
+
+// APU volumes, where amplitude 1.0 is 0x10000 in samples. Squares' sum of 0 to
+// 30 becomes 0 to 15360, and triangle/noise/DMC's 0 to 196 becomes 0 to 25090.
+double const sq_volume  = 1.0 / 128;
+double const tnd_volume = 1.0 / 512;
+
+// Table index is sample >> 3, offset so that filter ringing below 0 stays in it
+int const table_shift = Blip_Buffer::delta_bits + 3;
+int const table_size  = 4096;
+int const table_zero  = 512;
+
+// Both DACs at maximum sum to 1.0, which is scaled to the largest 16-bit
+// sample so that the APU alone never clips
+double const dac_gain = 0x7FFF * (1 << Blip_Buffer::delta_bits);
+
+// Raw output samples for each DAC's input
+struct Nes_Dac_Tables {
+	int sq  [table_size];
+	int tnd [table_size];
+
+	Nes_Dac_Tables()
+	{
+		for ( int i = 0; i < table_size; i++ )
+		{
+			double sample = (double) ((i - table_zero) << (table_shift - Blip_Buffer::delta_bits));
+
+			double n = sample / (sq_volume * 0x10000);
+			sq [i] = (int) (95.88 * n / (8128 + 100 * n) * dac_gain);
+
+			n = sample / (tnd_volume * 0x10000);
+			tnd [i] = (int) (159.79 * n / (22638 + 100 * n) * dac_gain);
+		}
+	}
+};
+
+static Nes_Dac_Tables const& dac_tables()
+{
+	static Nes_Dac_Tables const tables;
+	return tables;
+}
+
+Nes_Buffer::Nes_Buffer() : Multi_Buffer( 1 )
+{
+	dacs [0].table = dac_tables().sq;
+	dacs [1].table = dac_tables().tnd;
+	for ( dac_t& dac : dacs )
+		dac.accum = dac.prev = 0;
+}
+
+Nes_Buffer::~Nes_Buffer() { }
+
+void Nes_Buffer::set_apu( Nes_Apu* apu )
+{
+	apu->enable_nonlinear_( sq_volume, tnd_volume );
+	for ( int i = 0; i < Nes_Apu::osc_count; i++ )
+		apu->set_output( i, channel( i ).center );
+}
+
+Nes_Buffer::channel_t Nes_Buffer::channel( int i )
+{
+	channel_t ch;
+	ch.center = &buf;
+	if ( i < 2 )
+		ch.center = &dacs [0].buf;
+	else if ( i < Nes_Apu::osc_count )
+		ch.center = &dacs [1].buf;
+	ch.left  = ch.center;
+	ch.right = ch.center;
+	return ch;
+}
+
+std::error_condition Nes_Buffer::set_sample_rate( int rate, int msec )
+{
+	std::error_condition err = buf.set_sample_rate( rate, msec );
+	for ( int i = 0; i < 2 && !err; i++ )
+		err = dacs [i].buf.set_sample_rate( rate, msec );
+	if ( err )
+		return err;
+	clear();
+	return Multi_Buffer::set_sample_rate( buf.sample_rate(), buf.length() );
+}
+
+void Nes_Buffer::clock_rate( int rate )
+{
+	buf.clock_rate( rate );
+	for ( dac_t& dac : dacs )
+		dac.buf.clock_rate( rate );
+}
+
+void Nes_Buffer::set_rate_adjustment( double r )
+{
+	buf.set_rate_adjustment( r );
+	for ( dac_t& dac : dacs )
+		dac.buf.set_rate_adjustment( r );
+}
+
+void Nes_Buffer::bass_freq( int freq )
+{
+	buf.bass_freq( freq );
+	for ( dac_t& dac : dacs )
+		dac.buf.bass_freq( freq );
+}
+
+void Nes_Buffer::clear()
+{
+	buf.clear();
+	for ( dac_t& dac : dacs )
+	{
+		dac.buf.clear();
+		dac.accum = 0;
+		dac.prev  = 0;
+	}
+}
+
+void Nes_Buffer::end_frame( blip_time_t time )
+{
+	buf.end_frame( time );
+	for ( dac_t& dac : dacs )
+		dac.buf.end_frame( time );
+}
+
+int Nes_Buffer::samples_avail() const
+{
+	return buf.samples_avail();
+}
+
+// Integrates each DAC's deltas without the high-pass filter, looks up its
+// output, then adds the differences of that to buf's deltas, so that reading
+// buf filters and mixes everything in one pass
+int Nes_Buffer::mix_nonlinear( int count )
+{
+	count = std::min( count, buf.samples_avail() );
+	Blip_Buffer::delta_t* const out = buf.read_pos();
+	for ( dac_t& dac : dacs )
+	{
+		Blip_Buffer::delta_t const* const in = dac.buf.read_pos();
+		int const* const table = dac.table;
+		int accum = dac.accum;
+		int prev  = dac.prev;
+		for ( int i = 0; i < count; i++ )
+		{
+			accum += in [i];
+			unsigned index = (accum >> table_shift) + table_zero;
+			if ( index >= (unsigned) table_size )
+				index = (accum < 0 ? 0 : table_size - 1);
+			int entry = table [index];
+			out [i] += entry - prev;
+			prev = entry;
+		}
+		dac.accum = accum;
+		dac.prev  = prev;
+		dac.buf.remove_samples( count );
+	}
+	return count;
+}
+
+int Nes_Buffer::read_samples( blip_sample_t out [], int count )
+{
+	return buf.read_samples( out, mix_nonlinear( count ) );
+}
+
+int Nes_Buffer::read_samples_float( float out [], int count )
+{
+	return buf.read_samples_float( out, mix_nonlinear( count ) );
+}
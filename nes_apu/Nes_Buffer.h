@@ -0,0 +1,51 @@
+// NES nonlinear sound buffer
+#pragma once
+
+#include "Multi_Buffer.h"
+
+class Nes_Apu;
+
+// Mixes the APU's squares and its triangle, noise and DMC with the 2A03's
+// nonlinear DAC response, using lookup tables. Other sound chips go to
+// buffer() and are mixed in linearly. Outputs mono samples.
+class Nes_Buffer : public Multi_Buffer {
+public:
+	Nes_Buffer();
+	~Nes_Buffer();
+
+	// Puts APU in nonlinear mode and sets its outputs to this buffer
+	void set_apu( Nes_Apu* );
+
+	// Buffer for other sound chips to output to
+	Blip_Buffer* buffer()                       { return &buf; }
+
+	// Channels 0 and 1 are the APU's squares, 2 to 4 its triangle, noise and
+	// DMC, and any others use buffer()
+	virtual channel_t channel( int );
+
+// Implementation
+public:
+	virtual std::error_condition set_sample_rate( int rate, int msec = blip_default_length );
+	virtual void clock_rate( int );
+	virtual void set_rate_adjustment( double );
+	virtual void bass_freq( int );
+	virtual void clear();
+	virtual void end_frame( blip_time_t );
+	virtual int samples_avail() const;
+	virtual int read_samples( blip_sample_t [], int );
+	virtual int read_samples_float( float [], int );
+
+private:
+	// Input to a nonlinear DAC, with its own table
+	struct dac_t {
+		Blip_Buffer buf;
+		int const* table;
+		int accum; // sum of deltas so far, without high-pass filter
+		int prev;  // table output for accum
+	};
+
+	Blip_Buffer buf;
+	dac_t dacs [2]; // squares, then triangle/noise/DMC
+
+	int mix_nonlinear( int count );
+};
@@ -1,4 +1,5 @@
 #include "Nes_Fds_Apu.h"
+#include "Nes_State.h"
 
 /* Copyright (C) 2006 Shay Green. This module is free software; you
 can redistribute it and/or modify it under the terms of the GNU Lesser
@@ -95,6 +96,12 @@ void Nes_Fds_Apu::write_( uint16_t addr, uint8_t data )
 	}
 }
 
+void Nes_Fds_Apu::write_registers( apu_write_t const writes [], size_t count )
+{
+	for ( size_t i = 0; i < count; i++ )
+		write( writes [i].time, writes [i].addr, writes [i].data );
+}
+
 void Nes_Fds_Apu::set_tempo( double t )
 {
 	lfo_tempo = lfo_base_tempo;
@@ -276,3 +283,54 @@ void Nes_Fds_Apu::run_until( blip_time_t final_end_time )
 	}
 	last_time = final_end_time;
 }
+
+uint32_t const fds_state_tag = nes_state_tag( "FDS " );
+int const fds_state_version = 1;
+
+void Nes_Fds_Apu::save_state( Nes_State_Writer& out ) const
+{
+	out.begin_block( fds_state_tag, fds_state_version );
+	out.write32( last_time );
+	out.write_bytes( regs_, sizeof regs_ );
+	out.write_bytes( mod_wave, sizeof mod_wave );
+	out.write32( env_delay );
+	out.write8 ( env_speed );
+	out.write8 ( env_gain );
+	out.write32( sweep_delay );
+	out.write8 ( sweep_speed );
+	out.write8 ( sweep_gain );
+	out.write8 ( wave_pos );
+	out.write32( last_amp );
+	out.write32( wave_fract );
+	out.write32( mod_fract );
+	out.write8 ( mod_pos );
+	out.write8 ( mod_write_pos );
+	out.end_block();
+}
+
+std::error_condition Nes_Fds_Apu::load_state( Nes_State_Reader& in )
+{
+	if ( in.begin_block( fds_state_tag, fds_state_version ) )
+	{
+		last_time = in.read32();
+		in.read_bytes( regs_, sizeof regs_ );
+		in.read_bytes( mod_wave, sizeof mod_wave );
+		env_delay     = in.read32();
+		env_speed     = in.read8();
+		env_gain      = in.read8();
+		sweep_delay   = in.read32();
+		sweep_speed   = in.read8();
+		sweep_gain    = in.read8();
+		wave_pos      = in.read8() & (wave_size - 1);
+		last_amp      = in.read32();
+		wave_fract    = in.read32();
+		mod_fract     = in.read32();
+		mod_pos       = in.read8() & (wave_size - 1);
+		mod_write_pos = in.read8() & (wave_size - 1);
+		in.end_block();
+	}
+	
+	if ( in.error() )
+		reset();
+	return in.error();
+}
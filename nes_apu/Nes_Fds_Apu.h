@@ -17,9 +17,15 @@ public:
 	enum { io_addr = 0x4040 };
 	enum { io_size = 0x53 };
 	void write( blip_time_t time, uint16_t addr, uint8_t data );
+	void write_registers( apu_write_t const [], size_t count ); // in time order
 	uint8_t read( blip_time_t time, uint16_t addr );
 	void end_frame( blip_time_t ) override;
 	
+	// Saves/loads exact state in portable format (see Nes_State.h). Loading
+	// a bad state resets the chip and returns an error.
+	void save_state( Nes_State_Writer& ) const;
+	std::error_condition load_state( Nes_State_Reader& );
+	
 public:
 	Nes_Fds_Apu();
 	void write_( uint16_t addr, uint8_t data );
@@ -1,4 +1,5 @@
 #include "Nes_Fme7_Apu.h"
+#include "Nes_State.h"
 
 /* Copyright (C) 2003-2006 Shay Green. This module is free software; you
 can redistribute it and/or modify it under the terms of the GNU Lesser
@@ -117,3 +118,54 @@ void Nes_Fme7_Apu::run_until( blip_time_t end_time )
 	last_time = end_time;
 }
 
+void Nes_Fme7_Apu::write_registers( apu_write_t const writes [], size_t count )
+{
+	for ( size_t i = 0; i < count; i++ )
+	{
+		apu_write_t const& w = writes [i];
+		switch ( w.addr & addr_mask )
+		{
+			case latch_addr: write_latch( w.data ); break;
+			case data_addr:  write_data( w.time, w.data ); break;
+		}
+	}
+}
+
+uint32_t const fme7_state_tag = nes_state_tag( "FME7" );
+int const fme7_state_version = 1;
+
+void Nes_Fme7_Apu::save_state( Nes_State_Writer& out ) const
+{
+	out.begin_block( fme7_state_tag, fme7_state_version );
+	out.write32( last_time );
+	out.write_bytes( regs, sizeof regs );
+	out.write8( latch );
+	for ( int i = 0; i < osc_count; i++ )
+	{
+		out.write8 ( phases [i] );
+		out.write16( delays [i] );
+		out.write32( oscs [i].last_amp );
+	}
+	out.end_block();
+}
+
+std::error_condition Nes_Fme7_Apu::load_state( Nes_State_Reader& in )
+{
+	if ( in.begin_block( fme7_state_tag, fme7_state_version ) )
+	{
+		last_time = in.read32();
+		in.read_bytes( regs, sizeof regs );
+		latch = in.read8();
+		for ( int i = 0; i < osc_count; i++ )
+		{
+			phases [i]        = in.read8() & 1;
+			delays [i]        = in.read16();
+			oscs [i].last_amp = in.read32();
+		}
+		in.end_block();
+	}
+	
+	if ( in.error() )
+		reset();
+	return in.error();
+}
@@ -25,6 +25,11 @@ public:
 	void save_state( fme7_apu_state_t* ) const;
 	void load_state( fme7_apu_state_t const& );
 	
+	// Saves/loads exact state in portable format (see Nes_State.h). Loading
+	// a bad state resets the chip and returns an error.
+	void save_state( Nes_State_Writer& ) const;
+	std::error_condition load_state( Nes_State_Reader& );
+	
 	// Mask and addresses of registers
 	enum { addr_mask = 0xE000 };
 	enum { data_addr = 0xE000 };
@@ -36,6 +41,9 @@ public:
 	// (addr & addr_mask) == data_addr
 	void write_data( blip_time_t, uint8_t data );
 	
+	// Writes to latch or data by address, in time order. Other addresses are ignored.
+	void write_registers( apu_write_t const [], size_t count );
+	
 public:
 	Nes_Fme7_Apu();
 private:
@@ -0,0 +1,230 @@
+#include "Nes_Frame_Pipeline.h"
+
+/* This module is free software; you can redistribute it and/or modify it
+under the terms of the GNU Lesser General Public License as published by the
+Free Software Foundation; either version 2.1 of the License, or (at your
+option) any later version. This module is distributed in the hope that it will
+be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General
+Public License for more details. You should have received a copy of the GNU
+Lesser General Public License along with this module; if not, write to the Free
+Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301 USA */
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct Nes_Frame_Pipeline::Shared {
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable start;
+	std::condition_variable done;
+	unsigned generation; // incremented for each end_frame()
+	int busy;            // threads still running chips this frame
+	int next_chip;       // next chip for a thread to take
+	blip_time_t end_time;
+	bool stop;
+
+	std::vector<apu_write_t> writes [max_chips];
+};
+
+static int to_gain( double v )
+{
+	int gain = (int) (v * Blip_Mixer::gain_unit + (v < 0 ? -0.5 : 0.5));
+	return std::max( -0x8000, std::min( 0x7FFF, gain ) );
+}
+
+Nes_Frame_Pipeline::Nes_Frame_Pipeline( int max_threads_ ) : max_threads( max_threads_ )
+{
+	if ( max_threads < 0 )
+		max_threads = std::max( (int) std::thread::hardware_concurrency() - 1, 0 );
+	chip_count = 0;
+	shared = new Shared;
+	shared->generation = 0;
+	shared->busy = 0;
+	shared->next_chip = 0;
+	shared->end_time = 0;
+	shared->stop = false;
+}
+
+Nes_Frame_Pipeline::~Nes_Frame_Pipeline()
+{
+	{
+		std::lock_guard<std::mutex> lock( shared->mutex );
+		shared->stop = true;
+	}
+	shared->start.notify_all();
+	for ( std::thread& thread : shared->threads )
+		thread.join();
+	delete shared;
+}
+
+int Nes_Frame_Pipeline::add_chip_( Nes_Apu_Base* chip, write_func_t func, double left, double right )
+{
+	assert( chip_count < max_chips );
+	assert( shared->threads.empty() ); // must be added before set_sample_rate()
+	int index = chip_count++;
+	chips [index].chip = chip;
+	chips [index].write_registers = func;
+	inputs [index].buf = &chips [index].buf;
+	inputs [index].gain [0] = to_gain( left );
+	inputs [index].gain [1] = to_gain( right );
+	return index;
+}
+
+Blip_Buffer* Nes_Frame_Pipeline::add_buffer( double left, double right )
+{
+	return &chips [add_chip_( nullptr, nullptr, left, right )].buf;
+}
+
+std::error_condition Nes_Frame_Pipeline::set_sample_rate( int rate, int msec )
+{
+	for ( int i = 0; i < chip_count; i++ )
+	{
+		std::error_condition err = chips [i].buf.set_sample_rate( rate, msec );
+		if ( err )
+			return err;
+	}
+	if ( shared->threads.empty() )
+		start_threads();
+	return {};
+}
+
+void Nes_Frame_Pipeline::start_threads()
+{
+	int run_count = 0;
+	for ( int i = 0; i < chip_count; i++ )
+		run_count += (chips [i].chip != nullptr);
+
+	// caller runs chips too
+	int const count = std::min( max_threads, run_count - 1 );
+	for ( int i = 0; i < count; i++ )
+		shared->threads.push_back( std::thread( &Nes_Frame_Pipeline::work, this ) );
+}
+
+void Nes_Frame_Pipeline::clock_rate( int rate )
+{
+	for ( int i = 0; i < chip_count; i++ )
+		chips [i].buf.clock_rate( rate );
+}
+
+void Nes_Frame_Pipeline::set_rate_adjustment( double r )
+{
+	for ( int i = 0; i < chip_count; i++ )
+		chips [i].buf.set_rate_adjustment( r );
+}
+
+void Nes_Frame_Pipeline::bass_freq( int freq )
+{
+	for ( int i = 0; i < chip_count; i++ )
+		chips [i].buf.bass_freq( freq );
+}
+
+void Nes_Frame_Pipeline::clear()
+{
+	for ( int i = 0; i < chip_count; i++ )
+		chips [i].buf.clear();
+}
+
+void Nes_Frame_Pipeline::write( int index, blip_time_t time, uint16_t addr, uint8_t data )
+{
+	assert( (unsigned) index < (unsigned) chip_count && chips [index].chip );
+	std::vector<apu_write_t>& writes = shared->writes [index];
+	assert( writes.empty() || writes.back().time <= time ); // must be in time order
+	apu_write_t w = { time, addr, data };
+	writes.push_back( w );
+}
+
+// Takes chips until there are none left
+void Nes_Frame_Pipeline::run_chips()
+{
+	while ( true )
+	{
+		int index;
+		{
+			std::lock_guard<std::mutex> lock( shared->mutex );
+			index = shared->next_chip++;
+		}
+		if ( index >= chip_count )
+			break;
+
+		chip_t& c = chips [index];
+		if ( c.chip )
+		{
+			std::vector<apu_write_t>& writes = shared->writes [index];
+			c.write_registers( c.chip, writes.data(), writes.size() );
+			writes.clear();
+			c.chip->end_frame( shared->end_time );
+		}
+	}
+}
+
+void Nes_Frame_Pipeline::work()
+{
+	unsigned generation = 0;
+	while ( true )
+	{
+		{
+			std::unique_lock<std::mutex> lock( shared->mutex );
+			shared->start.wait( lock, [&] { return shared->stop || shared->generation != generation; } );
+			if ( shared->stop )
+				return;
+			generation = shared->generation;
+		}
+
+		run_chips();
+
+		std::lock_guard<std::mutex> lock( shared->mutex );
+		if ( --shared->busy == 0 )
+			shared->done.notify_one();
+	}
+}
+
+void Nes_Frame_Pipeline::end_frame( blip_time_t time )
+{
+	if ( shared->threads.empty() )
+	{
+		shared->next_chip = 0;
+		shared->end_time = time;
+		run_chips();
+	}
+	else
+	{
+		{
+			std::lock_guard<std::mutex> lock( shared->mutex );
+			shared->next_chip = 0;
+			shared->end_time = time;
+			shared->busy = (int) shared->threads.size();
+			shared->generation++;
+		}
+		shared->start.notify_all();
+		run_chips();
+
+		std::unique_lock<std::mutex> lock( shared->mutex );
+		shared->done.wait( lock, [this] { return shared->busy == 0; } );
+	}
+
+	for ( int i = 0; i < chip_count; i++ )
+		chips [i].buf.end_frame( time );
+}
+
+int Nes_Frame_Pipeline::samples_avail() const
+{
+	if ( !chip_count )
+		return 0;
+	int n = chips [0].buf.samples_avail();
+	for ( int i = 1; i < chip_count; i++ )
+		n = std::min( n, chips [i].buf.samples_avail() );
+	return n;
+}
+
+int Nes_Frame_Pipeline::read_samples( blip_sample_t out [], int count )
+{
+	count = std::min( count, samples_avail() );
+	if ( count )
+		Blip_Mixer::read_pairs( inputs, chip_count, out, count );
+	return count;
+}
@@ -0,0 +1,88 @@
+// Runs a cartridge's sound chips on separate threads each frame
+#pragma once
+
+#include "Multi_Buffer.h"
+#include "Nes_Apu_Base.h"
+
+// Register writes to each chip are recorded during a frame, then at the end of
+// it every chip is run on its own thread into its own buffer, and the buffers
+// are mixed to stereo with Blip_Mixer. Each chip's output only depends on its
+// writes, so the mix is the same however the threads are scheduled.
+//
+// A chip run here only catches up at end_frame(), so anything that reads its
+// state mid-frame (status and IRQ reads, the DMC's memory reads) sees it late.
+// Run such a chip directly as usual, into a buffer from add_buffer().
+class DLLEXPORT Nes_Frame_Pipeline {
+public:
+	// Uses up to max_threads threads besides the caller's, or one fewer than
+	// the number of processors if -1. No more are started than there are chips
+	// to share the work with.
+	explicit Nes_Frame_Pipeline( int max_threads = -1 );
+	~Nes_Frame_Pipeline();
+
+	// Adds chip to be run by end_frame(), with its output set to a new buffer
+	// with the given gains. Chip must have a write_registers() member. Returns
+	// index to pass to write().
+	enum { max_chips = 8 };
+	template<class Chip>
+	int add_chip( Chip*, double left = 1.0, double right = 1.0 );
+
+	// Adds buffer to be mixed in, for a chip that's run directly
+	Blip_Buffer* add_buffer( double left = 1.0, double right = 1.0 );
+
+	// Sets sample rate of all buffers and starts threads. All chips and buffers
+	// must have been added first.
+	std::error_condition set_sample_rate( int rate, int msec = blip_default_length );
+	void clock_rate( int );
+	void set_rate_adjustment( double );
+	void bass_freq( int );
+	void clear();
+
+	// Records register write for chip added as index, to be made at end_frame()
+	void write( int index, blip_time_t, uint16_t addr, uint8_t data );
+
+	// Makes each chip's writes and runs it to time, on separate threads, then
+	// ends the frame in all buffers. Chips run directly must already have had
+	// their end_frame() called.
+	void end_frame( blip_time_t time );
+
+	// Number of stereo pairs available in all buffers
+	int samples_avail() const;
+
+	// Mixes up to count stereo pairs into out and returns number of pairs read
+	int read_samples( blip_sample_t out [], int count );
+
+private:
+	// noncopyable
+	Nes_Frame_Pipeline( const Nes_Frame_Pipeline& );
+	Nes_Frame_Pipeline& operator = ( const Nes_Frame_Pipeline& );
+
+	typedef void (*write_func_t)( Nes_Apu_Base*, apu_write_t const [], size_t count );
+
+	struct Shared;
+	struct chip_t {
+		Nes_Apu_Base* chip; // null if run directly
+		write_func_t write_registers;
+		Blip_Buffer buf;
+	};
+	chip_t chips [max_chips];
+	Blip_Mixer::input_t inputs [max_chips];
+	int chip_count;
+	int max_threads;
+	Shared* shared;
+
+	int add_chip_( Nes_Apu_Base*, write_func_t, double left, double right );
+	void start_threads();
+	void work();
+	void run_chips();
+};
+
+template<class Chip>
+inline int Nes_Frame_Pipeline::add_chip( Chip* chip, double left, double right )
+{
+	int index = add_chip_( chip, []( Nes_Apu_Base* c, apu_write_t const w [], size_t count ) {
+		static_cast<Chip*>( c )->write_registers( w, count );
+	}, left, right );
+	chip->set_output( &chips [index].buf );
+	return index;
+}
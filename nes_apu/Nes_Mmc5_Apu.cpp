@@ -13,6 +13,7 @@
    Boston, MA 02110-1301 USA */
 
 #include "Nes_Mmc5_Apu.h"
+#include "Nes_State.h"
 
 int const amp_range = 15;
 
@@ -236,6 +237,12 @@ void Nes_Mmc5_Apu::write_register(blip_time_t time, uint16_t addr, uint8_t data)
 	}
 }
 
+void Nes_Mmc5_Apu::write_registers(apu_write_t const writes[], size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		write_register(writes[i].time, writes[i].addr, writes[i].data);
+}
+
 
 uint8_t Nes_Mmc5_Apu::read_status(blip_time_t time)
 {
@@ -304,3 +311,47 @@ void Nes_Mmc5_Pcm::update_irq(bool newIrq)
 	if (old_irq != irq_flag && apu->irq_notifier)
 		apu->irq_notifier(irq_flag);
 }
+
+uint32_t const mmc5_state_tag = nes_state_tag("MMC5");
+int const mmc5_state_version = 1;
+
+void Nes_Mmc5_Apu::save_state(Nes_State_Writer& out) const
+{
+	out.begin_block(mmc5_state_tag, mmc5_state_version);
+	out.write32(last_time);
+	out.write32(frame_delay);
+	out.write8(square1_enabled | square2_enabled << 1);
+	out.write8(pcm_mode);
+	square1.save_state(out);
+	square2.save_state(out);
+	out.write8(pcm.irq_enabled);
+	out.write8(pcm.irq_flag);
+	out.write32(pcm.last_amp);
+	out.end_block();
+}
+
+std::error_condition Nes_Mmc5_Apu::load_state(Nes_State_Reader& in)
+{
+	if (in.begin_block(mmc5_state_tag, mmc5_state_version))
+	{
+		last_time = in.read32();
+		frame_delay = in.read32();
+		int enables = in.read8();
+		square1_enabled = (enables & 1) != 0;
+		square2_enabled = (enables & 2) != 0;
+		pcm_mode = in.read8() != 0;
+		square1.load_state(in);
+		square2.load_state(in);
+		pcm.irq_enabled = in.read8() != 0;
+		bool irq = in.read8() != 0;
+		pcm.last_amp = in.read32();
+		in.end_block();
+
+		if (!in.error())
+			pcm.update_irq(irq);
+	}
+
+	if (in.error())
+		reset();
+	return in.error();
+}
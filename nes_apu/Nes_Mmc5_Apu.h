@@ -6,7 +6,6 @@
 
 #include <functional>
 
-struct apu_state_t;
 class Nes_Buffer;
 class Nes_Mmc5_Apu;
 
@@ -38,6 +37,9 @@ public:
 	
 	void write_register(blip_time_t, uint16_t addr, uint8_t data);
 
+	// Same as calling write_register() for each of count writes, in time order
+	void write_registers(apu_write_t const[], size_t count);
+
 	// All time values are the number of CPU clock cycles relative to the
 	// beginning of the current time frame. Before resetting the CPU clock
 	// count, call end_frame( last_cpu_time ).
@@ -66,9 +68,10 @@ public:
 	enum { osc_count = 3 };
 	void set_output(int chan, Blip_Buffer* buf);
 
-	// Saves/loads exact emulation state
-	void save_state(apu_state_t* out) const;
-	void load_state(apu_state_t const&);
+	// Saves/loads exact emulation state in portable format (see Nes_State.h).
+	// Loading a bad state resets the chip and returns an error.
+	void save_state(Nes_State_Writer&) const;
+	std::error_condition load_state(Nes_State_Reader&);
 
 	// Sets overall volume (default is 1.0)
 	void volume(double) override;
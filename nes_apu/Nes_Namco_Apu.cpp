@@ -1,4 +1,5 @@
 #include "Nes_Namco_Apu.h"
+#include "Nes_State.h"
 
 /* Copyright (C) 2003-2006 Shay Green. This module is free software; you
 can redistribute it and/or modify it under the terms of the GNU Lesser
@@ -11,6 +12,8 @@ details. You should have received a copy of the GNU Lesser General Public
 License along with this module; if not, write to the Free Software Foundation,
 Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA */
 
+#include <cstring>
+
 Nes_Namco_Apu::Nes_Namco_Apu()
 {
 	set_output( nullptr );
@@ -22,6 +25,7 @@ void Nes_Namco_Apu::reset()
 {
 	last_time = 0;
 	addr_reg = 0;
+	wave_dirty = (1 << osc_count) - 1;
 	
 	int i;
 	for ( i = 0; i < reg_count; i++ )
@@ -66,6 +70,82 @@ void Nes_Namco_Apu::reflect_state( Tagged_Data& data )
 }
 */
 
+void Nes_Namco_Apu::save_state( namco_state_t* out ) const
+{
+	memcpy( out->regs, reg, sizeof out->regs );
+	out->addr = (uint8_t) addr_reg;
+	out->unused [0] = 0;
+	out->unused [1] = 0;
+	out->unused [2] = 0;
+	for ( int i = 0; i < osc_count; i++ )
+	{
+		Namco_Osc const& osc = oscs [i];
+		out->positions [i] = (uint8_t) osc.wave_pos;
+		out->amps      [i] = (uint8_t) osc.last_amp;
+		out->delays    [i] = osc.delay;
+	}
+	out->last_time = last_time;
+}
+
+void Nes_Namco_Apu::load_state( namco_state_t const& in )
+{
+	memcpy( reg, in.regs, sizeof reg );
+	addr_reg = in.addr;
+	for ( int i = 0; i < osc_count; i++ )
+	{
+		Namco_Osc& osc = oscs [i];
+		// struct may come from elsewhere, so keep values run_until() indexes
+		// or times with in range
+		osc.wave_pos = in.positions [i] % max_wave_size;
+		osc.last_amp = in.amps [i];
+		osc.delay    = (in.delays [i] > 0 ? in.delays [i] : 0);
+	}
+	last_time = (in.last_time > 0 ? in.last_time : 0);
+	wave_dirty = (1 << osc_count) - 1;
+}
+
+uint32_t const namco_state_tag = nes_state_tag( "N163" );
+int const namco_state_version = 1;
+
+void Nes_Namco_Apu::save_state( Nes_State_Writer& out ) const
+{
+	out.begin_block( namco_state_tag, namco_state_version );
+	out.write32( last_time );
+	out.write8( addr_reg );
+	out.write_bytes( reg, sizeof reg );
+	for ( int i = 0; i < osc_count; i++ )
+	{
+		Namco_Osc const& osc = oscs [i];
+		out.write32( osc.delay );
+		out.write16( osc.last_amp );
+		out.write16( osc.wave_pos );
+	}
+	out.end_block();
+}
+
+std::error_condition Nes_Namco_Apu::load_state( Nes_State_Reader& in )
+{
+	if ( in.begin_block( namco_state_tag, namco_state_version ) )
+	{
+		last_time = in.read32();
+		addr_reg  = in.read8();
+		in.read_bytes( reg, sizeof reg );
+		for ( int i = 0; i < osc_count; i++ )
+		{
+			Namco_Osc& osc = oscs [i];
+			osc.delay    = in.read32();
+			osc.last_amp = (short) in.read16();
+			osc.wave_pos = (short) (in.read16() % max_wave_size);
+		}
+		in.end_block();
+	}
+	wave_dirty = (1 << osc_count) - 1;
+	
+	if ( in.error() )
+		reset();
+	return in.error();
+}
+
 void Nes_Namco_Apu::end_frame( blip_time_t time )
 {
 	if ( time > last_time )
@@ -75,6 +155,49 @@ void Nes_Namco_Apu::end_frame( blip_time_t time )
 	last_time -= time;
 }
 
+void Nes_Namco_Apu::write_registers( apu_write_t const writes [], size_t count )
+{
+	for ( size_t i = 0; i < count; i++ )
+	{
+		apu_write_t const& w = writes [i];
+		switch ( w.addr & reg_addr_mask )
+		{
+			case data_reg_addr: write_data( w.time, w.data ); break;
+			case addr_reg_addr: write_addr( w.data ); break;
+		}
+	}
+}
+
+// Marks waves that depend on register at addr as needing decoding
+void Nes_Namco_Apu::invalidate_waves( int addr )
+{
+	for ( int i = 0; i < osc_count; i++ )
+	{
+		int const osc_addr = i * 8 + 0x40;
+		int const offset = reg [osc_addr + 6];
+		
+		// register holds samples addr * 2 and addr * 2 + 1
+		int pos = (addr * 2 - offset) & 0xFF;
+		if ( pos < max_wave_size || pos == 0xFF ||
+				addr == osc_addr + 4 || addr == osc_addr + 6 || addr == osc_addr + 7 )
+			wave_dirty |= 1 << i;
+	}
+}
+
+// Decodes all positions, since wave_pos can be past a newly shortened wave
+void Nes_Namco_Apu::decode_wave( int i )
+{
+	uint8_t const* osc_reg = &reg [i * 8 + 0x40];
+	int const volume = osc_reg [7] & 15;
+	uint8_t* wave = oscs [i].wave;
+	for ( int n = 0; n < max_wave_size; n++ )
+	{
+		int addr = (osc_reg [6] + n) & 0xFF; // wave RAM wraps around
+		wave [n] = (uint8_t) ((reg [addr >> 1] >> (addr << 2 & 4) & 15) * volume);
+	}
+	wave_dirty &= ~(1 << i);
+}
+
 void Nes_Namco_Apu::run_until( blip_time_t nes_end_time )
 {
 	int active_oscs = (reg [0x7F] >> 4 & 7) + 1;
@@ -115,6 +238,10 @@ void Nes_Namco_Apu::run_until( blip_time_t nes_end_time )
 			if ( !wave_size )
 				continue;
 			
+			if ( wave_dirty & (1 << i) )
+				decode_wave( i );
+			
+			uint8_t const* wave = osc.wave;
 			int last_amp = osc.last_amp;
 			int wave_pos = osc.wave_pos;
 			
@@ -122,11 +249,8 @@ void Nes_Namco_Apu::run_until( blip_time_t nes_end_time )
 			
 			do
 			{
-				// read wave sample
-				int addr = wave_pos + osc_reg [6];
-				int sample = reg [addr >> 1] >> (addr << 2 & 4);
+				int sample = wave [wave_pos];
 				wave_pos++;
-				sample = (sample & 15) * volume;
 				
 				// output impulse if amplitude changed
 				int delta = sample - last_amp;
@@ -25,10 +25,20 @@ public:
 	enum { addr_reg_addr = 0xF800 };
 	void write_addr( uint8_t );
 	
-	// to do: implement save/restore
+	// Writes to either register, each mirrored through the 0x800 bytes
+	// following it, in time order. Other addresses are ignored.
+	enum { reg_addr_mask = 0xF800 };
+	void write_registers( apu_write_t const [], size_t count );
+	
+	// Saves/loads exact state as a fixed-size struct, for rollback and the like
 	void save_state( namco_state_t* out ) const;
 	void load_state( namco_state_t const& );
 	
+	// Saves/loads exact state in portable format (see Nes_State.h). Loading
+	// a bad state resets the chip and returns an error.
+	void save_state( Nes_State_Writer& ) const;
+	std::error_condition load_state( Nes_State_Reader& );
+	
 public:
 	Nes_Namco_Apu();
 private:
@@ -36,14 +46,17 @@ private:
 	Nes_Namco_Apu( const Nes_Namco_Apu& );
 	Nes_Namco_Apu& operator = ( const Nes_Namco_Apu& );
 	
+	enum { max_wave_size = 32 };
 	struct Namco_Osc {
 		int delay;
 		Blip_Buffer* output;
 		short last_amp;
 		short wave_pos;
+		uint8_t wave [max_wave_size]; // samples already multiplied by volume
 	};
 	
 	Namco_Osc oscs [osc_count];
+	int wave_dirty; // bit set for each osc whose wave needs decoding
 	
 	blip_time_t last_time;
 	int addr_reg;
@@ -61,17 +74,20 @@ private:
 	
 	uint8_t& access();
 	void run_until( blip_time_t );
+	void invalidate_waves( int addr );
+	void decode_wave( int index );
 };
-/*
 struct namco_state_t
 {
 	uint8_t regs [0x80];
 	uint8_t addr;
-	uint8_t unused;
+	uint8_t unused [3];
 	uint8_t positions [8];
-	uint32_t delays [8];
+	uint8_t amps [8];
+	int32_t delays [8];
+	int32_t last_time;
 };
-*/
+static_assert( sizeof (namco_state_t) == 184, "namco_state_t should be exactly 184 bytes" );
 
 inline uint8_t& Nes_Namco_Apu::access()
 {
@@ -98,5 +114,7 @@ inline void Nes_Namco_Apu::set_output( int i, Blip_Buffer* buf )
 inline void Nes_Namco_Apu::write_data( blip_time_t time, uint8_t data )
 {
 	run_until( time );
+	int addr = addr_reg & 0x7F;
 	access() = data;
+	invalidate_waves( addr );
 }
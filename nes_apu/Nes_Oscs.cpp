@@ -1,4 +1,5 @@
 #include "Nes_Apu.h"
+#include "Nes_State.h"
 
 /* Copyright (C) 2003-2006 Shay Green. This module is free software; you
 can redistribute it and/or modify it under the terms of the GNU Lesser
@@ -11,6 +12,13 @@ details. You should have received a copy of the GNU Lesser General Public
 License along with this module; if not, write to the Free Software Foundation,
 Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA */
 
+unsigned char const Nes_Apu_Tables::length [0x20] = {
+	0x0A, 0xFE, 0x14, 0x02, 0x28, 0x04, 0x50, 0x06,
+	0xA0, 0x08, 0x3C, 0x0A, 0x0E, 0x0C, 0x1A, 0x0E, 
+	0x0C, 0x10, 0x18, 0x12, 0x30, 0x14, 0x60, 0x16,
+	0xC0, 0x18, 0x48, 0x1A, 0x10, 0x1C, 0x20, 0x1E
+};
+
 // Nes_Osc
 
 void Nes_Osc::clock_length( int halt_mask )
@@ -19,6 +27,20 @@ void Nes_Osc::clock_length( int halt_mask )
 		length_counter--;
 }
 
+// Advances a divider that counts delay down past 0 then reloads it with period,
+// by count clocks. Returns number of reloads.
+static int skip_divider( int& delay, int period, int count )
+{
+	if ( count <= delay )
+	{
+		delay -= count;
+		return 0;
+	}
+	count -= delay + 1;
+	delay = period - count % (period + 1);
+	return count / (period + 1) + 1;
+}
+
 void Nes_Envelope::clock_envelope()
 {
 	int period = regs [0] & 15;
@@ -41,6 +63,28 @@ int Nes_Envelope::volume() const
 	return length_counter == 0 ? 0 : (regs [0] & 0x10) ? (regs [0] & 15) : envelope;
 }
 
+void Nes_Envelope::skip_envelope( int count )
+{
+	assert( !reg_written [3] );
+	int reloads = skip_divider( env_delay, regs [0] & 15, count );
+	if ( regs [0] & 0x20 )
+		envelope = (envelope - reloads) & 15;
+	else
+		envelope = (reloads < envelope ? envelope - reloads : 0);
+}
+
+bool Nes_Envelope::muted() const
+{
+	if ( length_counter == 0 )
+		return true;
+	
+	if ( regs [0] & 0x10 )
+		return (regs [0] & 15) == 0;
+	
+	// envelope is only restarted by a write, or by looping
+	return envelope == 0 && !(regs [0] & 0x20) && !reg_written [3];
+}
+
 // Nes_Square
 
 void Nes_Square::clock_sweep( int negative_adjust )
@@ -77,6 +121,47 @@ void Nes_Square::clock_sweep( int negative_adjust )
 	}
 }
 
+// True if clock_sweep() won't change the period
+bool Nes_Square::sweep_steady( int negative_adjust ) const
+{
+	if ( reg_written [1] )
+		return false;
+	
+	int const period = this->period();
+	int const shift = regs [1] & shift_mask;
+	if ( !shift || !(regs [1] & 0x80) || period < 8 )
+		return true;
+	
+	int offset = period >> shift;
+	if ( regs [1] & negate_flag )
+		offset = negative_adjust - offset;
+	return !offset || period + offset >= 0x800;
+}
+
+void Nes_Square::skip_sweep( int count )
+{
+	skip_divider( sweep_delay, (regs [1] >> 4) & 7, count );
+}
+
+// True if run() will neither output anything nor be affected by frame
+// sequencer clocks until a register is written, so it can be run less often
+bool Nes_Square::idle() const
+{
+	// sweep can change period, which changes how phase advances
+	if ( (regs [1] & 0x80) && (regs [1] & shift_mask) )
+		return false;
+	
+	if ( !output )
+		return true;
+	
+	int const period = this->period();
+	int offset = period >> (regs [1] & shift_mask);
+	if ( regs [1] & negate_flag )
+		offset = 0;
+	
+	return !last_amp && (muted() || period < min_period || (period + offset) >= 0x800);
+}
+
 // TODO: clean up
 inline Nes_Square::nes_time_t Nes_Square::maintain_phase( nes_time_t time, nes_time_t end_time,
 		nes_time_t timer_period )
@@ -91,17 +176,23 @@ inline Nes_Square::nes_time_t Nes_Square::maintain_phase( nes_time_t time, nes_t
 	return time;
 }
 
+void Nes_Square::skip( nes_time_t time, nes_time_t end_time )
+{
+	const int timer_period = (period() + 1) * 2;
+	delay = maintain_phase( time + delay, end_time, timer_period ) - end_time;
+}
+
 void Nes_Square::run( nes_time_t time, nes_time_t end_time )
 {
-	const int period = this->period();
-	const int timer_period = (period + 1) * 2;
-	
 	if ( !output )
 	{
-		delay = maintain_phase( time + delay, end_time, timer_period ) - end_time;
+		skip( time, end_time );
 		return;
 	}
 	
+	const int period = this->period();
+	const int timer_period = (period + 1) * 2;
+	
 	int offset = period >> (regs [1] & shift_mask);
 	if ( regs [1] & negate_flag )
 		offset = 0;
@@ -148,17 +239,22 @@ void Nes_Square::run( nes_time_t time, nes_time_t end_time )
 			int delta = amp * 2 - volume;
 			int phase = this->phase;
 			
+			Nes_Osc_Batch batch;
+			blip_resampled_time_t rtime = output->resampled_time( time );
+			blip_resampled_time_t const rperiod = output->resampled_duration( timer_period );
 			do
 			{
 				phase = (phase + 1) & (phase_range - 1);
 				if ( phase == 0 || phase == duty )
 				{
 					delta = -delta;
-					synth.offset_inline( time, delta, output );
+					batch.add( rtime, delta, synth, output );
 				}
 				time += timer_period;
+				rtime += rperiod;
 			}
 			while ( time < end_time );
+			batch.flush( synth, output );
 			
 			last_amp = (delta + volume) >> 1;
 			this->phase = phase;
@@ -189,6 +285,24 @@ inline int Nes_Triangle::calc_amp() const
 	return amp;
 }
 
+bool Nes_Triangle::linear_counter_steady() const
+{
+	if ( reg_written [3] )
+		return (regs [0] & 0x80) != 0; // reloaded every clock
+	return linear_counter == 0;
+}
+
+// See Nes_Square::idle()
+bool Nes_Triangle::idle() const
+{
+	if ( output && last_amp != calc_amp() )
+		return false;
+	
+	// linear counter is only reloaded after a write
+	return length_counter == 0 || (linear_counter == 0 && !reg_written [3]) ||
+			period() + 1 < 3;
+}
+
 // TODO: clean up
 inline Nes_Square::nes_time_t Nes_Triangle::maintain_phase( nes_time_t time, nes_time_t end_time,
 		nes_time_t timer_period )
@@ -197,25 +311,31 @@ inline Nes_Square::nes_time_t Nes_Triangle::maintain_phase( nes_time_t time, nes
 	if ( remain > 0 )
 	{
 		int count = (remain + timer_period - 1) / timer_period;
-		phase = ((unsigned) phase + 1 - count) & (phase_range * 2 - 1);
-		phase++;
+		phase = (((unsigned) phase - 1 - count) & (phase_range * 2 - 1)) + 1;
 		time += count * timer_period;
 	}
 	return time;
 }
 
-void Nes_Triangle::run( nes_time_t time, nes_time_t end_time )
+void Nes_Triangle::skip( nes_time_t time, nes_time_t end_time )
 {
 	const int timer_period = period() + 1;
+	time += delay;
+	delay = 0;
+	if ( length_counter && linear_counter && timer_period >= 3 )
+		delay = maintain_phase( time, end_time, timer_period ) - end_time;
+}
+
+void Nes_Triangle::run( nes_time_t time, nes_time_t end_time )
+{
 	if ( !output )
 	{
-		time += delay;
-		delay = 0;
-		if ( length_counter && linear_counter && timer_period >= 3 )
-			delay = maintain_phase( time, end_time, timer_period ) - end_time;
+		skip( time, end_time );
 		return;
 	}
 	
+	const int timer_period = period() + 1;
+	
 	// to do: track phase when period < 3
 	// to do: Output 7.5 on dac when period < 2? More accurate, but results in more clicks.
 	
@@ -244,6 +364,9 @@ void Nes_Triangle::run( nes_time_t time, nes_time_t end_time )
 		}
 		output->set_modified();
 		
+		Nes_Osc_Batch batch;
+		blip_resampled_time_t rtime = output->resampled_time( time );
+		blip_resampled_time_t const rperiod = output->resampled_duration( timer_period );
 		do
 		{
 			if ( --phase == 0 )
@@ -253,12 +376,14 @@ void Nes_Triangle::run( nes_time_t time, nes_time_t end_time )
 			}
 			else
 			{
-				synth.offset_inline( time, volume, output );
+				batch.add( rtime, volume, synth, output );
 			}
 			
 			time += timer_period;
+			rtime += rperiod;
 		}
 		while ( time < end_time );
+		batch.flush( synth, output );
 		
 		if ( volume < 0 )
 			phase += phase_range;
@@ -328,7 +453,7 @@ int Nes_Dmc::count_reads( nes_time_t time, nes_time_t* last_read ) const
 	return count;
 }
 
-static short const dmc_period_table [2] [16] = {
+short const Nes_Apu_Tables::dmc_period [2] [16] = {
 	{428, 380, 340, 320, 286, 254, 226, 214, // NTSC
 	190, 160, 142, 128, 106,  84,  72,  54},
 
@@ -342,7 +467,7 @@ inline void Nes_Dmc::reload_sample()
 	length_counter = regs [3] * 0x10 + 1;
 }
 
-static int const dmc_table [128] =
+int const Nes_Apu_Tables::dmc_dac [128] =
 {
    0,  24,  48,  71,  94, 118, 141, 163, 186, 209, 231, 253, 275, 297, 319, 340,
  361, 383, 404, 425, 445, 466, 486, 507, 527, 547, 567, 587, 606, 626, 645, 664,
@@ -357,7 +482,7 @@ static int const dmc_table [128] =
 inline int Nes_Dmc::update_amp_nonlinear( int in )
 {
 	if ( !nonlinear )
-		in = dmc_table [in];
+		in = Nes_Apu_Tables::dmc_dac [in];
 	int delta = in - last_amp;
 	last_amp = in;
 	return delta;
@@ -367,7 +492,7 @@ void Nes_Dmc::write_register( int addr, int data )
 {
 	if ( addr == 0 )
 	{
-		period = dmc_period_table [pal_mode] [data & 15];
+		period = Nes_Apu_Tables::dmc_period [pal_mode] [data & 15];
 		irq_enabled = (data & 0xC0) == 0x80; // enabled only if loop disabled
 		irq_flag &= irq_enabled;
 		recalc_irq();
@@ -487,24 +612,108 @@ void Nes_Dmc::run( nes_time_t time, nes_time_t end_time )
 
 // Nes_Noise
 
-static short const noise_period_table [16] = {
+short const Nes_Apu_Tables::noise_period [16] = {
 	0x004, 0x008, 0x010, 0x020, 0x040, 0x060, 0x080, 0x0A0,
 	0x0CA, 0x0FE, 0x17C, 0x1FC, 0x2FA, 0x3F8, 0x7F2, 0xFE4
 };
 
+// Jumps over any number of shift register steps. A step is linear over GF(2),
+// so 2^i steps of each mode are precomputed as matrices, and a jump applies
+// the ones for each bit of the step count.
+class Noise_Jumps {
+public:
+	Noise_Jumps()
+	{
+		init( 0, 13, long_length );
+		init( 1,  8, short_length );
+	}
+	
+	int jump( int noise, bool short_mode, unsigned count ) const
+	{
+		Mode const& m = modes [short_mode];
+		count %= m.length;
+		for ( int i = 0; count; i++, count >>= 1 )
+		{
+			if ( count & 1 )
+				noise = apply( m.steps [i], noise );
+		}
+		return noise;
+	}
+	
+private:
+	// Normal mode has a single 32767-step sequence. Short mode has many 93-step
+	// sequences and one of 31 steps, so all repeat after 93.
+	enum { long_length = 32767 };
+	enum { short_length = 93 };
+	enum { bits = 15 };
+	
+	struct Mode {
+		unsigned length;
+		unsigned short steps [bits] [bits]; // [i] [b] = 2^i steps of register with only bit b set
+	};
+	Mode modes [2];
+	
+	static int apply( unsigned short const matrix [bits], int noise )
+	{
+		int out = 0;
+		for ( ; noise; noise &= noise - 1 )
+			out ^= matrix [Nes_Apu_Tables::lowest_bit( noise )];
+		return out;
+	}
+	
+	void init( int mode, int tap, unsigned length )
+	{
+		Mode& m = modes [mode];
+		m.length = length;
+		for ( int b = 0; b < bits; b++ )
+		{
+			int n = 1 << b;
+			m.steps [0] [b] = ((n << tap ^ n << 14) & 0x4000) | (n >> 1);
+		}
+		for ( int i = 1; i < bits; i++ )
+			for ( int b = 0; b < bits; b++ )
+				m.steps [i] [b] = apply( m.steps [i - 1], m.steps [i - 1] [b] );
+	}
+};
+
+static Noise_Jumps const& noise_jumps()
+{
+	static Noise_Jumps const jumps;
+	return jumps;
+}
+
+int Nes_Apu_Tables::jump_noise( int noise, bool short_mode, unsigned count )
+{
+	return noise_jumps().jump( noise, short_mode, count );
+}
+
+void Nes_Noise::skip( nes_time_t time, nes_time_t end_time )
+{
+	int period = Nes_Apu_Tables::noise_period [regs [2] & 15];
+	time += delay;
+	if ( time < end_time )
+	{
+		int count = (end_time - time + period - 1) / period;
+		noise = Nes_Apu_Tables::jump_noise( noise, (regs [2] & mode_flag) != 0, count );
+		time += count * period;
+	}
+	delay = time - end_time;
+}
+
+// See Nes_Square::idle()
+bool Nes_Noise::idle() const
+{
+	return !output || (!last_amp && muted());
+}
+
 void Nes_Noise::run( nes_time_t time, nes_time_t end_time )
 {
-	int period = noise_period_table [regs [2] & 15];
-	
 	if ( !output )
 	{
-		// TODO: clean up
-		time += delay;
-		delay = time + (end_time - time + period - 1) / period * period - end_time;
+		skip( time, end_time );
 		return;
 	}
 	
-	
 	const int volume = this->volume();
 	int amp = (noise & 1) ? volume : 0;
 	{
@@ -516,59 +725,166 @@ void Nes_Noise::run( nes_time_t time, nes_time_t end_time )
 		}
 	}
 	
+	if ( !volume )
+	{
+		skip( time, end_time );
+		return;
+	}
+	
+	int const period = Nes_Apu_Tables::noise_period [regs [2] & 15];
 	time += delay;
 	if ( time < end_time )
 	{
-		const int mode_flag = 0x80;
+		Blip_Buffer* const output = this->output;
 		
-		if ( !volume )
-		{
-			// round to next multiple of period
-			time += (end_time - time + period - 1) / period * period;
-			
-			// approximate noise cycling while muted, by shuffling up noise register
-			// to do: precise muted noise cycling?
-			if ( !(regs [2] & mode_flag) )
-			{
-				int feedback = (noise << 13) ^ (noise << 14);
-				noise = (feedback & 0x4000) | (noise >> 1);
-			}
-		}
-		else
+		// using resampled time avoids conversion in synth.offset()
+		blip_resampled_time_t rperiod = output->resampled_duration( period );
+		blip_resampled_time_t rtime = output->resampled_time( time );
+		
+		int count = (end_time - time + period - 1) / period;
+		time += count * period;
+		
+		// Output changes on each step where bits 0 and 1 differ. The bits that
+		// the next few steps shift down and feed back are all in the register
+		// already, so transitions are found and the register is stepped a
+		// window of steps at a time.
+		int const feedback_bit = (regs [2] & mode_flag ? 6 : 1);
+		int const window = 15 - feedback_bit;
+		
+		int noise = this->noise;
+		int delta = amp * 2 - volume;
+		output->set_modified();
+		
+		Nes_Osc_Batch batch;
+		do
 		{
-			Blip_Buffer* const output = this->output;
-			
-			// using resampled time avoids conversion in synth.offset()
-			blip_resampled_time_t rperiod = output->resampled_duration( period );
-			blip_resampled_time_t rtime = output->resampled_time( time );
+			int const steps = (count < window ? count : window);
+			int const mask = (1 << steps) - 1;
 			
-			int noise = this->noise;
-			int delta = amp * 2 - volume;
-			const int tap = (regs [2] & mode_flag ? 8 : 13);
-			output->set_modified();
-			
-			do
+			for ( int changes = (noise ^ (noise >> 1)) & mask; changes; changes &= changes - 1 )
 			{
-				int feedback = (noise << tap) ^ (noise << 14);
-				time += period;
-				
-				if ( (noise + 1) & 2 )
-				{
-					// bits 0 and 1 of noise differ
-					delta = -delta;
-					synth.offset_resampled( rtime, delta, output );
-				}
-				
-				rtime += rperiod;
-				noise = (feedback & 0x4000) | (noise >> 1);
+				delta = -delta;
+				batch.add( rtime + Nes_Apu_Tables::lowest_bit( changes ) * rperiod, delta, synth, output );
 			}
-			while ( time < end_time );
 			
-			last_amp = (delta + volume) >> 1;
-			this->noise = noise;
+			int feedback = (noise ^ (noise >> feedback_bit)) & mask;
+			noise = (noise >> steps) | (feedback << (15 - steps));
+			rtime += steps * rperiod;
+			count -= steps;
 		}
+		while ( count );
+		batch.flush( synth, output );
+		
+		last_amp = (delta + volume) >> 1;
+		this->noise = noise;
 	}
 	
 	delay = time - end_time;
 }
 
+// Save states
+
+void Nes_Osc::save_state( Nes_State_Writer& out ) const
+{
+	out.write_bytes( regs, sizeof regs );
+	out.write8( reg_written [0] | reg_written [1] << 1 | reg_written [2] << 2 | reg_written [3] << 3 );
+	out.write16( length_counter );
+	out.write32( delay );
+	out.write32( last_amp );
+}
+
+void Nes_Osc::load_state( Nes_State_Reader& in )
+{
+	in.read_bytes( regs, sizeof regs );
+	int written = in.read8();
+	for ( int i = 0; i < 4; i++ )
+		reg_written [i] = (written >> i) & 1;
+	length_counter = in.read16();
+	delay          = in.read32();
+	last_amp       = in.read32();
+}
+
+void Nes_Envelope::save_state( Nes_State_Writer& out ) const
+{
+	Nes_Osc::save_state( out );
+	out.write8( envelope );
+	out.write8( env_delay );
+}
+
+void Nes_Envelope::load_state( Nes_State_Reader& in )
+{
+	Nes_Osc::load_state( in );
+	envelope  = in.read8();
+	env_delay = in.read8();
+}
+
+void Nes_Square::save_state( Nes_State_Writer& out ) const
+{
+	Nes_Envelope::save_state( out );
+	out.write8( phase );
+	out.write8( sweep_delay );
+}
+
+void Nes_Square::load_state( Nes_State_Reader& in )
+{
+	Nes_Envelope::load_state( in );
+	phase       = in.read8() & (phase_range - 1);
+	sweep_delay = in.read8();
+}
+
+void Nes_Triangle::save_state( Nes_State_Writer& out ) const
+{
+	Nes_Osc::save_state( out );
+	out.write8( phase );
+	out.write8( linear_counter );
+}
+
+void Nes_Triangle::load_state( Nes_State_Reader& in )
+{
+	Nes_Osc::load_state( in );
+	phase          = in.read8();
+	linear_counter = in.read8();
+}
+
+void Nes_Noise::save_state( Nes_State_Writer& out ) const
+{
+	Nes_Envelope::save_state( out );
+	out.write16( noise );
+}
+
+void Nes_Noise::load_state( Nes_State_Reader& in )
+{
+	Nes_Envelope::load_state( in );
+	noise = in.read16();
+}
+
+void Nes_Dmc::save_state( Nes_State_Writer& out ) const
+{
+	Nes_Osc::save_state( out );
+	out.write16( address );
+	out.write8 ( buf );
+	out.write8 ( bits_remain );
+	out.write8 ( bits );
+	out.write8 ( buf_full );
+	out.write8 ( silence );
+	out.write8 ( dac );
+	out.write8 ( irq_flag );
+	out.write32( next_irq );
+}
+
+void Nes_Dmc::load_state( Nes_State_Reader& in )
+{
+	Nes_Osc::load_state( in );
+	address     = in.read16() & 0x7FFF;
+	buf         = in.read8();
+	bits_remain = in.read8();
+	bits        = in.read8();
+	buf_full    = in.read8() != 0;
+	silence     = in.read8() != 0;
+	dac         = in.read8() & 0x7F;
+	irq_flag    = in.read8() != 0;
+	next_irq    = in.read32();
+	
+	period      = Nes_Apu_Tables::dmc_period [pal_mode] [regs [0] & 15];
+	irq_enabled = (regs [0] & 0xC0) == 0x80;
+}
@@ -17,10 +17,18 @@ struct Nes_Osc
 	int last_amp;   // last amplitude oscillator was outputting
 	
 	void clock_length( int halt_mask );
+	bool length_steady( int halt_mask ) const { // clock_length() won't change it
+		return !length_counter || (regs [0] & halt_mask);
+	}
 	int period() const {
 		return (regs [3] & 7) * 0x100 + (regs [2] & 0xFF);
 	}
 	void reset() {
+		for ( int i = 0; i < 4; i++ )
+		{
+			regs [i] = 0;
+			reg_written [i] = false;
+		}
 		delay = 0;
 		last_amp = 0;
 	}
@@ -29,6 +37,33 @@ struct Nes_Osc
 		last_amp = amp;
 		return delta;
 	}
+	void save_state( Nes_State_Writer& ) const;
+	void load_state( Nes_State_Reader& );
+};
+
+// Collects transitions made in a run() loop and adds them to the buffer in groups
+struct Nes_Osc_Batch
+{
+	enum { capacity = 32 };
+	blip_resampled_time_t time [capacity];
+	int delta [capacity];
+	int count;
+	
+	Nes_Osc_Batch() : count( 0 ) { }
+	
+	template<class Synth>
+	void add( blip_resampled_time_t t, int d, Synth const& synth, Blip_Buffer* output ) {
+		time [count] = t;
+		delta [count] = d;
+		if ( ++count == capacity )
+			flush( synth, output );
+	}
+	
+	template<class Synth>
+	void flush( Synth const& synth, Blip_Buffer* output ) {
+		synth.offset_resampled_batch( time, delta, count, output );
+		count = 0;
+	}
 };
 
 struct Nes_Envelope : Nes_Osc
@@ -37,12 +72,16 @@ struct Nes_Envelope : Nes_Osc
 	int env_delay;
 	
 	void clock_envelope();
+	void skip_envelope( int count ); // same as count clock_envelope() calls, if no write to regs [3]
 	int volume() const;
+	bool muted() const; // volume is 0 and will stay 0 until a register is written
 	void reset() {
 		envelope = 0;
 		env_delay = 0;
 		Nes_Osc::reset();
 	}
+	void save_state( Nes_State_Writer& ) const;
+	void load_state( Nes_State_Reader& );
 };
 
 // Nes_Square
@@ -61,11 +100,17 @@ struct Nes_Square : Nes_Envelope
 	Nes_Square(Synth const* s, int minimumPeriod=8) : synth( *s ), min_period(minimumPeriod) { }
 	
 	void clock_sweep( int adjust );
+	bool sweep_steady( int adjust ) const;
+	void skip_sweep( int count ); // same as count clock_sweep() calls, if sweep_steady()
 	void run( nes_time_t, nes_time_t );
+	void skip( nes_time_t, nes_time_t ); // same as run() without output
+	bool idle() const;
 	void reset() {
 		sweep_delay = 0;
 		Nes_Envelope::reset();
 	}
+	void save_state( Nes_State_Writer& ) const;
+	void load_state( Nes_State_Reader& );
 	nes_time_t maintain_phase( nes_time_t time, nes_time_t end_time,
 			nes_time_t timer_period );
 };
@@ -80,12 +125,17 @@ struct Nes_Triangle : Nes_Osc
 	
 	int calc_amp() const;
 	void run( nes_time_t, nes_time_t );
+	void skip( nes_time_t, nes_time_t );
+	bool idle() const;
 	void clock_linear_counter();
+	bool linear_counter_steady() const;
 	void reset() {
 		linear_counter = 0;
 		phase = 1;
 		Nes_Osc::reset();
 	}
+	void save_state( Nes_State_Writer& ) const;
+	void load_state( Nes_State_Reader& );
 	nes_time_t maintain_phase( nes_time_t time, nes_time_t end_time,
 			nes_time_t timer_period );
 };
@@ -93,14 +143,19 @@ struct Nes_Triangle : Nes_Osc
 // Nes_Noise
 struct Nes_Noise : Nes_Envelope
 {
+	enum { mode_flag = 0x80 };
 	int noise;
 	Blip_Synth_Fast synth;
 	
 	void run( nes_time_t, nes_time_t );
+	void skip( nes_time_t, nes_time_t ); // same as run() without output
+	bool idle() const;
 	void reset() {
 		noise = 1 << 14;
 		Nes_Envelope::reset();
 	}
+	void save_state( Nes_State_Writer& ) const;
+	void load_state( Nes_State_Reader& );
 };
 
 // Nes_Dmc
@@ -139,4 +194,31 @@ struct Nes_Dmc : Nes_Osc
 	void reset();
 	int count_reads( nes_time_t, nes_time_t* ) const;
 	nes_time_t next_read_time() const;
+	void save_state( Nes_State_Writer& ) const;
+	void load_state( Nes_State_Reader& ); // period and irq_enabled are recalculated
+};
+
+// Tables used by the oscillators and Nes_Apu
+struct DLLEXPORT Nes_Apu_Tables
+{
+	static unsigned char const length [0x20]; // length counter loads
+	static short const noise_period [16];
+	static short const dmc_period [2] [16];   // NTSC, PAL
+	static int const dmc_dac [128];           // DMC output in linear mode
+	
+	// Same as stepping noise shift register count times
+	static int jump_noise( int noise, bool short_mode, unsigned count );
+	
+	// Index of lowest set bit; n must be non-zero
+	static int lowest_bit( unsigned n )
+	{
+	#if defined(__GNUC__)
+		return __builtin_ctz( n );
+	#else
+		int i = 0;
+		for ( ; !(n & 1); n >>= 1 )
+			i++;
+		return i;
+	#endif
+	}
 };
@@ -0,0 +1,303 @@
+#include "Nes_Render_Pool.h"
+
+#include "Nes_Apu.h"
+#include "Nes_Fds_Apu.h"
+#include "Nes_Fme7_Apu.h"
+#include "Nes_Mmc5_Apu.h"
+#include "Nes_Namco_Apu.h"
+#include "Nes_Vrc6_Apu.h"
+#include "Nes_Vrc7_Apu.h"
+
+/* This module is free software; you can redistribute it and/or modify it
+under the terms of the GNU Lesser General Public License as published by the
+Free Software Foundation; either version 2.1 of the License, or (at your
+option) any later version. This module is distributed in the hope that it will
+be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General
+Public License for more details. You should have received a copy of the GNU
+Lesser General Public License along with this module; if not, write to the Free
+Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301 USA */
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+int const ntsc_clock_rate = 1789773;
+int const pal_clock_rate  = 1662607;
+int const frames_per_sec  = 60; // time frame length used for rendering
+
+struct Nes_Render_Pool::Worker {
+	std::thread thread;
+
+	// Jobs queued for this thread, taken from the back by it and from the front
+	// by others
+	std::mutex mutex;
+	std::deque<Nes_Render_Job const*> jobs;
+
+	Blip_Buffer buf;
+	Nes_Apu apu;
+	Nes_Vrc6_Apu vrc6;
+	Nes_Vrc7_Apu vrc7;
+	Nes_Fme7_Apu fme7;
+	Nes_Namco_Apu namco;
+	Nes_Fds_Apu fds;
+	Nes_Mmc5_Apu mmc5;
+	bool ready;
+
+	std::vector<apu_write_t> apu_writes;
+	std::vector<apu_write_t> exp_writes;
+	std::vector<blip_sample_t> samples;
+};
+
+struct Nes_Render_Pool::Shared {
+	std::mutex mutex;
+	std::condition_variable start;
+	std::condition_variable done;
+	unsigned generation; // incremented for each run()
+	size_t remain;       // jobs not yet finished
+	bool stop;
+};
+
+static int default_thread_count()
+{
+	unsigned n = std::thread::hardware_concurrency();
+	return n ? (int) n : 1;
+}
+
+Nes_Render_Pool::Nes_Render_Pool( int thread_count ) :
+	workers_size( thread_count > 0 ? thread_count : default_thread_count() )
+{
+	workers = new Worker [workers_size];
+	shared = new Shared;
+	shared->generation = 0;
+	shared->remain = 0;
+	shared->stop = false;
+	for ( int i = 0; i < workers_size; i++ )
+	{
+		workers [i].ready = false;
+		workers [i].thread = std::thread( &Nes_Render_Pool::work, this, i );
+	}
+}
+
+Nes_Render_Pool::~Nes_Render_Pool()
+{
+	{
+		std::lock_guard<std::mutex> lock( shared->mutex );
+		shared->stop = true;
+	}
+	shared->start.notify_all();
+	for ( int i = 0; i < workers_size; i++ )
+		workers [i].thread.join();
+	delete shared;
+	delete [] workers;
+}
+
+int Nes_Render_Pool::thread_count() const { return workers_size; }
+
+std::error_condition Nes_Render_Pool::set_sample_rate( int rate )
+{
+	for ( int i = 0; i < workers_size; i++ )
+	{
+		Worker& w = workers [i];
+		std::error_condition err = w.buf.set_sample_rate( rate );
+		if ( err )
+			return err;
+
+		if ( !w.ready )
+		{
+			err = w.vrc7.init();
+			if ( err )
+				return err;
+
+			w.apu.set_output( &w.buf );
+			w.vrc6.set_output( &w.buf );
+			w.vrc7.set_output( &w.buf );
+			w.fme7.set_output( &w.buf );
+			w.namco.set_output( &w.buf );
+			w.fds.set_output( &w.buf );
+			w.mmc5.set_output( &w.buf );
+			w.ready = true;
+		}
+		w.samples.resize( rate / frames_per_sec + 1 );
+	}
+	return {};
+}
+
+void Nes_Render_Pool::treble_eq( blip_eq_t const& eq )
+{
+	for ( int i = 0; i < workers_size; i++ )
+	{
+		Worker& w = workers [i];
+		w.apu.treble_eq( eq );
+		w.vrc6.treble_eq( eq );
+		w.vrc7.treble_eq( eq );
+		w.fme7.treble_eq( eq );
+		w.namco.treble_eq( eq );
+		w.fds.treble_eq( eq );
+		w.mmc5.treble_eq( eq );
+	}
+}
+
+void Nes_Render_Pool::run( Nes_Render_Job const jobs [], size_t count )
+{
+	assert( workers [0].ready ); // set_sample_rate() must have been called
+	if ( !count )
+		return;
+
+	// set before queueing, since threads still looking for work from the last
+	// run can take jobs as soon as they're queued
+	{
+		std::lock_guard<std::mutex> lock( shared->mutex );
+		shared->remain = count;
+	}
+
+	// give each thread a contiguous share of jobs
+	for ( int i = 0; i < workers_size; i++ )
+	{
+		Worker& w = workers [i];
+		size_t begin = count *  i      / workers_size;
+		size_t end   = count * (i + 1) / workers_size;
+		std::lock_guard<std::mutex> lock( w.mutex );
+		for ( size_t n = begin; n < end; n++ )
+			w.jobs.push_back( &jobs [n] );
+	}
+
+	std::unique_lock<std::mutex> lock( shared->mutex );
+	shared->generation++;
+	shared->start.notify_all();
+	shared->done.wait( lock, [this] { return shared->remain == 0; } );
+}
+
+bool Nes_Render_Pool::next_job( int index, Nes_Render_Job const** out )
+{
+	{
+		Worker& w = workers [index];
+		std::lock_guard<std::mutex> lock( w.mutex );
+		if ( !w.jobs.empty() )
+		{
+			*out = w.jobs.back();
+			w.jobs.pop_back();
+			return true;
+		}
+	}
+
+	for ( int i = 1; i < workers_size; i++ )
+	{
+		Worker& victim = workers [(index + i) % workers_size];
+		std::lock_guard<std::mutex> lock( victim.mutex );
+		if ( !victim.jobs.empty() )
+		{
+			*out = victim.jobs.front();
+			victim.jobs.pop_front();
+			return true;
+		}
+	}
+	return false;
+}
+
+void Nes_Render_Pool::work( int index )
+{
+	unsigned generation = 0;
+	while ( true )
+	{
+		{
+			std::unique_lock<std::mutex> lock( shared->mutex );
+			shared->start.wait( lock, [&] { return shared->stop || shared->generation != generation; } );
+			if ( shared->stop )
+				return;
+			generation = shared->generation;
+		}
+
+		Nes_Render_Job const* job;
+		while ( next_job( index, &job ) )
+		{
+			render( workers [index], *job );
+
+			std::lock_guard<std::mutex> lock( shared->mutex );
+			if ( --shared->remain == 0 )
+				shared->done.notify_one();
+		}
+	}
+}
+
+static bool is_apu_addr( uint16_t addr )
+{
+	return addr >= Nes_Apu::io_addr && addr < Nes_Apu::io_addr + Nes_Apu::io_size;
+}
+
+void Nes_Render_Pool::render( Worker& w, Nes_Render_Job const& job )
+{
+	int const clock_rate = (job.pal ? pal_clock_rate : ntsc_clock_rate);
+	int const frame_length = clock_rate / frames_per_sec;
+	w.buf.clock_rate( clock_rate );
+	w.buf.clear();
+
+	w.apu.reset( job.pal );
+	if ( job.dmc_reader )
+		w.apu.dmc_reader = job.dmc_reader;
+	else
+		w.apu.dmc_reader = []( int ) { return 0; };
+
+	Nes_Apu_Base* exp = nullptr;
+	switch ( job.expansion )
+	{
+		case Nes_Render_Job::no_chip:    break;
+		case Nes_Render_Job::vrc6_chip:  w.vrc6 .reset(); exp = &w.vrc6;  break;
+		case Nes_Render_Job::vrc7_chip:  w.vrc7 .reset(); exp = &w.vrc7;  break;
+		case Nes_Render_Job::fme7_chip:  w.fme7 .reset(); exp = &w.fme7;  break;
+		case Nes_Render_Job::namco_chip: w.namco.reset(); exp = &w.namco; break;
+		case Nes_Render_Job::fds_chip:   w.fds  .reset(); exp = &w.fds;   break;
+		case Nes_Render_Job::mmc5_chip:  w.mmc5 .reset(); exp = &w.mmc5;  break;
+	}
+
+	size_t next = 0;
+	for ( blip_time_t frame_start = 0; frame_start < job.length; frame_start += frame_length )
+	{
+		blip_time_t const end_time = std::min( frame_length, job.length - frame_start );
+
+		// split this frame's writes between chips, with times relative to it
+		w.apu_writes.clear();
+		w.exp_writes.clear();
+		for ( ; next < job.write_count && job.writes [next].time < frame_start + end_time; next++ )
+		{
+			apu_write_t write = job.writes [next];
+			assert( write.time >= frame_start ); // must be in time order
+			write.time -= frame_start;
+			if ( is_apu_addr( write.addr ) )
+				w.apu_writes.push_back( write );
+			else if ( exp )
+				w.exp_writes.push_back( write );
+		}
+
+		w.apu.write_registers( w.apu_writes.data(), w.apu_writes.size() );
+		w.apu.end_frame( end_time );
+		if ( exp )
+		{
+			apu_write_t const* writes = w.exp_writes.data();
+			size_t const count = w.exp_writes.size();
+			switch ( job.expansion )
+			{
+				case Nes_Render_Job::no_chip:    break;
+				case Nes_Render_Job::vrc6_chip:  w.vrc6 .write_registers( writes, count ); break;
+				case Nes_Render_Job::vrc7_chip:  w.vrc7 .write_registers( writes, count ); break;
+				case Nes_Render_Job::fme7_chip:  w.fme7 .write_registers( writes, count ); break;
+				case Nes_Render_Job::namco_chip: w.namco.write_registers( writes, count ); break;
+				case Nes_Render_Job::fds_chip:   w.fds  .write_registers( writes, count ); break;
+				case Nes_Render_Job::mmc5_chip:  w.mmc5 .write_registers( writes, count ); break;
+			}
+			exp->end_frame( end_time );
+		}
+		w.buf.end_frame( end_time );
+
+		while ( int count = w.buf.read_samples( w.samples.data(), (int) w.samples.size() ) )
+		{
+			if ( job.sink )
+				job.sink( w.samples.data(), count );
+		}
+	}
+	assert( next == job.write_count ); // write times must be less than length
+}
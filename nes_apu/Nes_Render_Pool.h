@@ -0,0 +1,81 @@
+// Renders many independent NES sound tracks on a pool of threads
+#pragma once
+
+#include "Nes_Apu_Base.h"
+#include <functional>
+#include <system_error>
+
+// Register writes for one track, played through the APU and optionally one
+// expansion chip, with its samples sent to sink as they're rendered
+struct Nes_Render_Job {
+	enum chip_t {
+		no_chip,
+		vrc6_chip,  // 0x9000-0xB002
+		vrc7_chip,  // 0x9010 latch, 0x9030 data
+		fme7_chip,  // 0xC000 latch, 0xE000 data
+		namco_chip, // 0x4800 data, 0xF800 address
+		fds_chip,   // 0x4040-0x4092
+		mmc5_chip   // 0x5000-0x5015
+	};
+	chip_t expansion;
+	bool pal;
+
+	// Writes in time order. Times are clocks from the start of the track, and
+	// must be less than length. Writes to 0x4000-0x4017 go to the APU and all
+	// others to the expansion chip.
+	apu_write_t const* writes;
+	size_t write_count;
+	Nes_Apu_Base::nes_time_t length;
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4251)
+#endif
+	// Memory reader for DMC samples; can be empty if DMC isn't used
+	std::function<int(int)> dmc_reader;
+
+	// Receives mono samples in order, on the thread rendering the job
+	std::function<void(blip_sample_t const*, int count)> sink;
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+};
+
+// Jobs are spread over one queue per thread, and threads that run out of work
+// steal from the others. Each thread keeps its own buffer and chips, so they
+// and their synth kernels are reused from job to job. Threads aren't pinned to
+// processors or NUMA nodes.
+class DLLEXPORT Nes_Render_Pool {
+public:
+	// Starts thread_count threads, or one for each processor if 0
+	explicit Nes_Render_Pool( int thread_count = 0 );
+	~Nes_Render_Pool();
+
+	int thread_count() const;
+
+	// Sets output sample rate and creates each thread's buffer and chips. Must
+	// be called before run().
+	std::error_condition set_sample_rate( int rate );
+
+	// Sets treble equalization of all chips (see Nes_Apu)
+	void treble_eq( blip_eq_t const& );
+
+	// Renders count jobs and returns when all have finished. Jobs must remain
+	// valid until then.
+	void run( Nes_Render_Job const jobs [], size_t count );
+
+private:
+	// noncopyable
+	Nes_Render_Pool( const Nes_Render_Pool& );
+	Nes_Render_Pool& operator = ( const Nes_Render_Pool& );
+
+	struct Worker;
+	struct Shared;
+	Worker* workers;
+	Shared* shared;
+	int const workers_size;
+
+	void work( int index );
+	bool next_job( int index, Nes_Render_Job const** out );
+	void render( Worker&, Nes_Render_Job const& );
+};
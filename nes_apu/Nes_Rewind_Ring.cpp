@@ -0,0 +1,293 @@
+#include "Nes_Rewind_Ring.h"
+
+/* This module is free software; you can redistribute it and/or modify it
+under the terms of the GNU Lesser General Public License as published by the
+Free Software Foundation; either version 2.1 of the License, or (at your
+option) any later version. This module is distributed in the hope that it will
+be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General
+Public License for more details. You should have received a copy of the GNU
+Lesser General Public License along with this module; if not, write to the Free
+Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301 USA */
+
+#include <assert.h>
+#include <cstdlib>
+#include <cstring>
+
+// A delta is stored as
+//
+//     size       32 bits, of whole delta
+//     prev_size  32 bits, size of state before
+//     new_size   32 bits, size of state after
+//     runs       until end of longer state
+//     size       32 bits, again, so deltas can be walked from either end
+//
+// where each run is a count of unchanged bytes and a count of changed bytes,
+// both as 7-bit variable-length numbers, then the changed bytes XORed with
+// their old values.
+
+int const header_size  = 12;
+int const trailer_size = 4;
+
+static void set_le32( uint8_t* p, size_t n )
+{
+	p [0] = (uint8_t) n;
+	p [1] = (uint8_t) (n >> 8);
+	p [2] = (uint8_t) (n >> 16);
+	p [3] = (uint8_t) (n >> 24);
+}
+
+static size_t get_le32( uint8_t const* p )
+{
+	return (size_t) p [3] << 24 | (size_t) p [2] << 16 | (size_t) p [1] << 8 | p [0];
+}
+
+static uint8_t* put_count( uint8_t* p, size_t n )
+{
+	while ( n >= 0x80 )
+	{
+		*p++ = (uint8_t) (n | 0x80);
+		n >>= 7;
+	}
+	*p++ = (uint8_t) n;
+	return p;
+}
+
+static uint8_t const* get_count( uint8_t const* p, size_t* out )
+{
+	size_t n = 0;
+	int shift = 0;
+	int b;
+	do
+	{
+		b = *p++;
+		n |= (size_t) (b & 0x7F) << shift;
+		shift += 7;
+	}
+	while ( b & 0x80 );
+	*out = n;
+	return p;
+}
+
+Nes_Rewind_Ring::Nes_Rewind_Ring()
+{
+	current   = nullptr;
+	max_size  = 0;
+	scratch   = nullptr;
+	ring      = nullptr;
+	ring_size = 0;
+	clear();
+}
+
+Nes_Rewind_Ring::~Nes_Rewind_Ring()
+{
+	free( current );
+	free( scratch );
+	free( ring );
+}
+
+std::error_condition Nes_Rewind_Ring::resize( size_t new_max_size, size_t new_ring_size )
+{
+	free( current );
+	free( scratch );
+	free( ring );
+
+	// worst case is every other byte changed, which takes three bytes per two
+	max_size  = new_max_size;
+	ring_size = new_ring_size;
+	current   = (uint8_t*) malloc( max_size ? max_size : 1 );
+	scratch   = (uint8_t*) malloc( max_size * 2 + header_size + trailer_size + 16 );
+	ring      = (uint8_t*) malloc( ring_size ? ring_size : 1 );
+	clear();
+	if ( !current || !scratch || !ring )
+	{
+		free( current );
+		free( scratch );
+		free( ring );
+		current = scratch = ring = nullptr;
+		max_size = ring_size = 0;
+		return std::make_error_condition( std::errc::not_enough_memory );
+	}
+	return {};
+}
+
+void Nes_Rewind_Ring::clear()
+{
+	current_size = 0;
+	has_state    = false;
+	head         = 0;
+	tail         = 0;
+	wrap_end     = 0;
+	wrapped      = false;
+	count_       = 0;
+}
+
+size_t Nes_Rewind_Ring::used() const
+{
+	if ( wrapped )
+		return wrap_end - tail + head;
+	return head - tail;
+}
+
+// Encodes delta from current to state into scratch, updates current to state,
+// and returns size of delta
+size_t Nes_Rewind_Ring::encode( uint8_t const* state, size_t size )
+{
+	size_t const common = (size < current_size ? size : current_size);
+	size_t const end    = (size > current_size ? size : current_size);
+	uint8_t* out = scratch + header_size;
+	size_t pos = 0;
+	while ( pos < end )
+	{
+		// unchanged bytes, compared a word at a time where possible
+		size_t start = pos;
+		while ( pos + sizeof (uint64_t) <= common )
+		{
+			uint64_t a, b;
+			memcpy( &a, current + pos, sizeof a );
+			memcpy( &b, state   + pos, sizeof b );
+			if ( a != b )
+				break;
+			pos += sizeof a;
+		}
+		while ( pos < common && current [pos] == state [pos] )
+			pos++;
+		if ( pos == end )
+			break; // rest unchanged; decoding stops at end anyway
+
+		// changed bytes, up to the next one that isn't
+		size_t changed = pos;
+		while ( pos < end && (pos >= common || current [pos] != state [pos]) )
+			pos++;
+
+		out = put_count( out, changed - start );
+		out = put_count( out, pos - changed );
+		for ( size_t i = changed; i < pos; i++ )
+		{
+			int old_byte = (i < current_size ? current [i] : 0);
+			int new_byte = (i < size ? state [i] : 0);
+			*out++ = (uint8_t) (old_byte ^ new_byte);
+			current [i] = (uint8_t) new_byte;
+		}
+	}
+
+	size_t const delta_size = (size_t) (out - scratch) + trailer_size;
+	set_le32( scratch,     delta_size );
+	set_le32( scratch + 4, current_size );
+	set_le32( scratch + 8, size );
+	set_le32( out,         delta_size );
+	current_size = size;
+	return delta_size;
+}
+
+void Nes_Rewind_Ring::drop_oldest()
+{
+	assert( count_ > 0 );
+	tail += get_le32( ring + tail );
+	if ( --count_ == 0 )
+	{
+		head = tail = 0;
+		wrapped = false;
+	}
+	else if ( wrapped && tail == wrap_end )
+	{
+		tail = 0;
+		wrapped = false;
+	}
+}
+
+// Moves head to where n bytes fit, dropping oldest deltas as needed. Returns
+// false if n is larger than ring.
+bool Nes_Rewind_Ring::make_room( size_t n )
+{
+	if ( n > ring_size )
+	{
+		while ( count_ )
+			drop_oldest();
+		return false;
+	}
+
+	while ( true )
+	{
+		if ( !wrapped )
+		{
+			if ( ring_size - head >= n )
+				return true;
+
+			if ( tail >= n )
+			{
+				wrap_end = head;
+				head     = 0;
+				wrapped  = true;
+				return true;
+			}
+		}
+		else if ( tail - head >= n )
+		{
+			return true;
+		}
+		drop_oldest();
+	}
+}
+
+std::error_condition Nes_Rewind_Ring::capture( void const* state, size_t size )
+{
+	if ( size > max_size )
+		return std::make_error_condition( std::errc::no_buffer_space );
+
+	if ( !has_state )
+	{
+		memcpy( current, state, size );
+		current_size = size;
+		has_state = true;
+		return {};
+	}
+
+	size_t n = encode( (uint8_t const*) state, size );
+	if ( make_room( n ) )
+	{
+		memcpy( ring + head, scratch, n );
+		head += n;
+		count_++;
+	}
+	return {};
+}
+
+bool Nes_Rewind_Ring::rewind()
+{
+	if ( !count_ )
+		return false;
+
+	if ( wrapped && head == 0 )
+	{
+		head    = wrap_end;
+		wrapped = false;
+	}
+
+	size_t const delta_size = get_le32( ring + head - trailer_size );
+	uint8_t const* p   = ring + head - delta_size;
+	size_t const prev  = get_le32( p + 4 );
+	uint8_t const* end = ring + head - trailer_size;
+	p += header_size;
+
+	size_t pos = 0;
+	while ( p < end )
+	{
+		size_t same, changed;
+		p = get_count( p, &same );
+		p = get_count( p, &changed );
+		pos += same;
+		for ( ; changed; changed-- )
+			current [pos++] ^= *p++;
+	}
+	current_size = prev;
+
+	head -= delta_size;
+	if ( --count_ == 0 )
+	{
+		head = tail = 0;
+		wrapped = false;
+	}
+	return true;
+}
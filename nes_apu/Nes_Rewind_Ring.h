@@ -0,0 +1,74 @@
+// Keeps a history of save states for rewinding, as deltas in a fixed-size ring
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <system_error>
+#include "dllexport.h"
+
+// Each captured state is stored as the XOR of it and the state before it,
+// run-length encoded, so a state that changed little from the last takes
+// little room. Only the newest state is kept whole; rewinding XORs it with the
+// newest delta to get the one before. When the ring is full, the oldest
+// deltas are dropped. Nothing is allocated after resize().
+//
+// States are typically written with Nes_State_Writer once per frame:
+//
+//     Nes_State_Writer out( scratch, sizeof scratch );
+//     apu.save_state( out );
+//     vrc6.save_state( out );
+//     buf.save_state( out );
+//     ring.capture( scratch, out.size() );
+//
+// and loaded from state() with Nes_State_Reader after rewind().
+class DLLEXPORT Nes_Rewind_Ring {
+public:
+	// Allocates room for states of up to max_state_size bytes, and ring_size
+	// bytes for deltas. Clears history.
+	std::error_condition resize( size_t max_state_size, size_t ring_size );
+
+	// Adds state as the newest, dropping oldest ones as needed to make room
+	std::error_condition capture( void const* state, size_t size );
+
+	// Newest state, or null if none
+	void const* state() const   { return has_state ? current : nullptr; }
+	size_t state_size() const   { return current_size; }
+
+	// Drops newest state, so the one before it becomes the newest. Returns false
+	// if there's no state before it.
+	bool rewind();
+
+	// Number of states before the newest that can be rewound to
+	int count() const           { return count_; }
+
+	// Bytes of ring used by deltas
+	size_t used() const;
+
+	// Removes all states
+	void clear();
+
+public:
+	Nes_Rewind_Ring();
+	~Nes_Rewind_Ring();
+private:
+	// noncopyable
+	Nes_Rewind_Ring( const Nes_Rewind_Ring& );
+	Nes_Rewind_Ring& operator = ( const Nes_Rewind_Ring& );
+
+	uint8_t* current;   // newest state
+	size_t current_size;
+	size_t max_size;
+	bool has_state;
+	uint8_t* scratch;   // delta being encoded
+	uint8_t* ring;
+	size_t ring_size;
+	size_t head;        // where next delta goes
+	size_t tail;        // oldest delta
+	size_t wrap_end;    // end of older deltas when newer ones wrapped to start
+	bool wrapped;
+	int count_;
+
+	size_t encode( uint8_t const* state, size_t size );
+	bool make_room( size_t );
+	void drop_oldest();
+};
@@ -0,0 +1,255 @@
+// Portable save states for Blip_Buffer and the sound chips
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <system_error>
+
+// A state is a sequence of blocks, one for each object saved, in the order
+// they were saved. Each block has a four-character tag, a version and its size,
+// followed by the object's fields as little-endian integers, so a state can be
+// stored on disk or sent to another machine. Neither side allocates memory.
+
+// Writes state into caller's memory
+class Nes_State_Writer {
+public:
+	// Writes into size bytes at out. If out is null, nothing is written and
+	// size() gives the number of bytes the state needs.
+	Nes_State_Writer( void* out, size_t size );
+
+	// Starts block. Everything written until end_block() goes into it.
+	void begin_block( uint32_t tag, int version );
+	void end_block();
+
+	// Writes low 8, 16 or 32 bits of n
+	void write8 ( int n );
+	void write16( int n );
+	void write32( int32_t n );
+	void write_bytes( void const*, size_t );
+
+	// Number of bytes written so far
+	size_t size() const { return pos; }
+
+	// Error if memory was too small for state
+	std::error_condition error() const;
+
+private:
+	uint8_t* const out;
+	size_t const capacity;
+	size_t pos;
+	size_t block; // position of current block's header
+	bool overflow;
+
+	uint8_t* reserve( size_t );
+};
+
+// Reads state written by Nes_State_Writer. Reads past the end of a block
+// return zero and end_block() skips anything not read, so a loader can accept
+// blocks written by older and newer versions. Errors are kept, so they only
+// need checking once after loading.
+class Nes_State_Reader {
+public:
+	Nes_State_Reader( void const* in, size_t size );
+
+	// Starts reading next block, which must have tag and a version no greater
+	// than max_version. Returns block's version, or 0 if error.
+	int begin_block( uint32_t tag, int max_version );
+	void end_block();
+
+	// Reads unsigned 8 or 16 bits, or signed 32 bits
+	int read8();
+	int read16();
+	int32_t read32();
+	void read_bytes( void*, size_t );
+
+	// Number of bytes read so far
+	size_t size() const { return pos; }
+
+	// Error if state was corrupt, truncated, or from a newer version
+	std::error_condition error() const { return err; }
+
+private:
+	uint8_t const* const in;
+	size_t const in_size;
+	size_t pos;
+	size_t block_end;
+	std::error_condition err;
+
+	uint8_t const* take( size_t );
+};
+
+// Tag for a block, from four characters, i.e. nes_state_tag( "APUR" )
+constexpr uint32_t nes_state_tag( char const (&s) [5] )
+{
+	return (uint32_t) (uint8_t) s [0] << 24 | (uint32_t) (uint8_t) s [1] << 16 |
+			(uint32_t) (uint8_t) s [2] << 8 | (uint32_t) (uint8_t) s [3];
+}
+
+int const nes_state_header_size = 10; // tag, version, size
+
+inline Nes_State_Writer::Nes_State_Writer( void* p, size_t n ) :
+	out( (uint8_t*) p ),
+	capacity( p ? n : 0 ),
+	pos( 0 ),
+	block( 0 ),
+	overflow( false )
+{ }
+
+inline uint8_t* Nes_State_Writer::reserve( size_t n )
+{
+	size_t p = pos;
+	pos += n;
+	if ( pos <= capacity )
+		return out + p;
+	overflow |= (out != nullptr);
+	return nullptr;
+}
+
+inline void Nes_State_Writer::write8( int n )
+{
+	if ( uint8_t* p = reserve( 1 ) )
+		p [0] = (uint8_t) n;
+}
+
+inline void Nes_State_Writer::write16( int n )
+{
+	if ( uint8_t* p = reserve( 2 ) )
+	{
+		p [0] = (uint8_t) n;
+		p [1] = (uint8_t) (n >> 8);
+	}
+}
+
+inline void Nes_State_Writer::write32( int32_t n )
+{
+	if ( uint8_t* p = reserve( 4 ) )
+	{
+		uint32_t u = (uint32_t) n;
+		p [0] = (uint8_t) u;
+		p [1] = (uint8_t) (u >> 8);
+		p [2] = (uint8_t) (u >> 16);
+		p [3] = (uint8_t) (u >> 24);
+	}
+}
+
+inline void Nes_State_Writer::write_bytes( void const* in, size_t n )
+{
+	if ( uint8_t* p = reserve( n ) )
+		memcpy( p, in, n );
+}
+
+inline void Nes_State_Writer::begin_block( uint32_t tag, int version )
+{
+	block = pos;
+	write8( tag >> 24 );
+	write8( tag >> 16 );
+	write8( tag >> 8 );
+	write8( tag );
+	write16( version );
+	write32( 0 ); // size is filled in by end_block()
+}
+
+inline void Nes_State_Writer::end_block()
+{
+	if ( pos <= capacity )
+	{
+		uint32_t n = (uint32_t) (pos - block - nes_state_header_size);
+		uint8_t* p = out + block + 6;
+		p [0] = (uint8_t) n;
+		p [1] = (uint8_t) (n >> 8);
+		p [2] = (uint8_t) (n >> 16);
+		p [3] = (uint8_t) (n >> 24);
+	}
+}
+
+inline std::error_condition Nes_State_Writer::error() const
+{
+	if ( overflow )
+		return std::make_error_condition( std::errc::no_buffer_space );
+	return {};
+}
+
+inline Nes_State_Reader::Nes_State_Reader( void const* p, size_t n ) :
+	in( (uint8_t const*) p ),
+	in_size( n ),
+	pos( 0 ),
+	block_end( 0 )
+{ }
+
+inline uint8_t const* Nes_State_Reader::take( size_t n )
+{
+	if ( pos > block_end || block_end - pos < n )
+		return nullptr;
+	uint8_t const* p = in + pos;
+	pos += n;
+	return p;
+}
+
+inline int Nes_State_Reader::read8()
+{
+	uint8_t const* p = take( 1 );
+	return p ? p [0] : 0;
+}
+
+inline int Nes_State_Reader::read16()
+{
+	uint8_t const* p = take( 2 );
+	return p ? p [1] * 0x100 + p [0] : 0;
+}
+
+inline int32_t Nes_State_Reader::read32()
+{
+	uint8_t const* p = take( 4 );
+	if ( !p )
+		return 0;
+	return (int32_t) ((uint32_t) p [3] << 24 | (uint32_t) p [2] << 16 |
+			(uint32_t) p [1] << 8 | p [0]);
+}
+
+inline void Nes_State_Reader::read_bytes( void* out, size_t n )
+{
+	uint8_t const* p = take( n );
+	if ( p )
+		memcpy( out, p, n );
+	else
+		memset( out, 0, n );
+}
+
+inline int Nes_State_Reader::begin_block( uint32_t tag, int max_version )
+{
+	block_end = pos;
+	if ( err )
+		return 0;
+
+	if ( in_size - pos < (size_t) nes_state_header_size )
+	{
+		err = std::make_error_condition( std::errc::illegal_byte_sequence );
+		return 0;
+	}
+
+	uint8_t const* p = in + pos;
+	uint32_t block_tag  = (uint32_t) p [0] << 24 | (uint32_t) p [1] << 16 | (uint32_t) p [2] << 8 | p [3];
+	int      version    = p [5] * 0x100 + p [4];
+	uint32_t block_size = (uint32_t) p [9] << 24 | (uint32_t) p [8] << 16 | (uint32_t) p [7] << 8 | p [6];
+	if ( block_tag != tag || block_size > in_size - pos - nes_state_header_size )
+	{
+		err = std::make_error_condition( std::errc::illegal_byte_sequence );
+		return 0;
+	}
+	if ( !version || version > max_version )
+	{
+		err = std::make_error_condition( std::errc::not_supported );
+		return 0;
+	}
+
+	pos += nes_state_header_size;
+	block_end = pos + block_size;
+	return version;
+}
+
+inline void Nes_State_Reader::end_block()
+{
+	if ( pos < block_end )
+		pos = block_end;
+}
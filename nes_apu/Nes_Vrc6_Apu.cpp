@@ -1,4 +1,5 @@
 #include "Nes_Vrc6_Apu.h"
+#include "Nes_State.h"
 
 /* Copyright (C) 2003-2006 Shay Green. This module is free software; you
 can redistribute it and/or modify it under the terms of the GNU Lesser
@@ -57,6 +58,19 @@ void Nes_Vrc6_Apu::write_osc( blip_time_t time, int osc_index, int reg, uint8_t
 	oscs [osc_index].regs [reg] = data;
 }
 
+void Nes_Vrc6_Apu::write_registers( apu_write_t const writes [], size_t count )
+{
+	for ( size_t i = 0; i < count; i++ )
+	{
+		apu_write_t const& w = writes [i];
+		// unsigned, so addresses below base_addr wrap high and are ignored
+		unsigned osc_index = (unsigned) (w.addr - base_addr) / addr_step;
+		unsigned reg = w.addr & (addr_step - 1);
+		if ( osc_index < osc_count && reg < reg_count )
+			write_osc( w.time, osc_index, reg, w.data );
+	}
+}
+
 void Nes_Vrc6_Apu::end_frame( blip_time_t time )
 {
 	if ( time > last_time )
@@ -98,6 +112,47 @@ void Nes_Vrc6_Apu::load_state( vrc6_apu_state_t const& in )
 		oscs [2].phase = 1;
 }
 
+uint32_t const vrc6_state_tag = nes_state_tag( "VRC6" );
+int const vrc6_state_version = 1;
+
+void Nes_Vrc6_Apu::save_state( Nes_State_Writer& out ) const
+{
+	out.begin_block( vrc6_state_tag, vrc6_state_version );
+	out.write32( last_time );
+	for ( int i = 0; i < osc_count; i++ )
+	{
+		Vrc6_Osc const& osc = oscs [i];
+		out.write_bytes( osc.regs, sizeof osc.regs );
+		out.write32( osc.delay );
+		out.write32( osc.last_amp );
+		out.write8 ( osc.phase );
+		out.write8 ( osc.amp );
+	}
+	out.end_block();
+}
+
+std::error_condition Nes_Vrc6_Apu::load_state( Nes_State_Reader& in )
+{
+	if ( in.begin_block( vrc6_state_tag, vrc6_state_version ) )
+	{
+		last_time = in.read32();
+		for ( int i = 0; i < osc_count; i++ )
+		{
+			Vrc6_Osc& osc = oscs [i];
+			in.read_bytes( osc.regs, sizeof osc.regs );
+			osc.delay    = in.read32();
+			osc.last_amp = in.read32();
+			osc.phase    = in.read8();
+			osc.amp      = in.read8();
+		}
+		in.end_block();
+	}
+	
+	if ( in.error() )
+		reset();
+	return in.error();
+}
+
 void Nes_Vrc6_Apu::run_square( Vrc6_Osc& osc, blip_time_t end_time )
 {
 	Blip_Buffer* output = osc.output;
@@ -18,6 +18,11 @@ public:
 	void save_state( vrc6_apu_state_t* ) const;
 	void load_state( vrc6_apu_state_t const& );
 	
+	// Saves/loads exact state in portable format (see Nes_State.h). Loading
+	// a bad state resets the chip and returns an error.
+	void save_state( Nes_State_Writer& ) const;
+	std::error_condition load_state( Nes_State_Reader& );
+	
 	// Oscillator 0 write-only registers are at $9000-$9002
 	// Oscillator 1 write-only registers are at $A000-$A002
 	// Oscillator 2 write-only registers are at $B000-$B002
@@ -26,6 +31,9 @@ public:
 	enum { addr_step = 0x1000 };
 	void write_osc( blip_time_t, int osc, int reg, uint8_t data );
 	
+	// Writes to registers by address, in time order. Other addresses are ignored.
+	void write_registers( apu_write_t const [], size_t count );
+	
 public:
 	Nes_Vrc6_Apu();
 private:
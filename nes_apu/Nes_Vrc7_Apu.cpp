@@ -1,12 +1,15 @@
 #include "Nes_Vrc7_Apu.h"
+#include "Nes_State.h"
 
 extern "C" {
 #include "emu2413.h"
 }
 
+#include <algorithm>
 #include <cstring>
 
 int const period = 36; // NES CPU clocks per FM clock
+int const block_size = 256; // FM clocks rendered at a time
 
 Nes_Vrc7_Apu::Nes_Vrc7_Apu()
 {
@@ -53,7 +56,7 @@ void Nes_Vrc7_Apu::output_changed()
 
 	if ( mono.output )
 	{
-		for ( int i = osc_count; --i; )
+		for ( int i = osc_count; --i >= 0; )
 		{
 			mono.last_amp += oscs [i].last_amp;
 			oscs [i].last_amp = 0;
@@ -99,6 +102,19 @@ void Nes_Vrc7_Apu::write_data( blip_time_t time, uint8_t data )
 	OPLL_writeReg((OPLL*)opll, addr, data);
 }
 
+void Nes_Vrc7_Apu::write_registers( apu_write_t const writes [], size_t count )
+{
+	for ( size_t i = 0; i < count; i++ )
+	{
+		apu_write_t const& w = writes [i];
+		switch ( w.addr & addr_mask )
+		{
+			case reg_addr:  write_reg( w.data ); break;
+			case data_addr: write_data( w.time, w.data ); break;
+		}
+	}
+}
+
 void Nes_Vrc7_Apu::end_frame( blip_time_t time )
 {
 	if ( time > next_time )
@@ -158,58 +174,211 @@ void Nes_Vrc7_Apu::load_snapshot( vrc7_snapshot_t const& in )
 	}
 }
 
+uint32_t const vrc7_state_tag = nes_state_tag( "VRC7" );
+int const vrc7_state_version = 2; // 2 added the OPLL's phases, envelopes and LFO
+
+// Each channel is a modulator and carrier slot, at 2 * channel and one after
+int const opll_slot_count = Nes_Vrc7_Apu::osc_count * 2;
+
+// Limits of envelope state and level, DAMP and EG_MUTE in emu2413.c
+int const opll_eg_state_max = 4;
+int const opll_eg_out_max = 0x7F;
+
+// OPLL state that its registers don't determine. Pointers and everything
+// derived from registers are rebuilt by writing the registers back. Rate
+// conversion isn't used at 3579545 / 72 Hz, so it has nothing to save.
+struct vrc7_opll_state_t
+{
+	struct {
+		uint32_t phase;
+		int32_t  output [2]; // modulator feedback
+		uint8_t  eg_state;
+		uint8_t  key_flag;
+		uint16_t eg_out;
+	} slots [opll_slot_count];
+	uint32_t eg_counter;
+	uint32_t pm_phase;
+	int32_t  am_phase;
+	uint8_t  lfo_am;
+	uint32_t noise;
+};
+
+void Nes_Vrc7_Apu::save_state( Nes_State_Writer& out ) const
+{
+	vrc7_snapshot_t snap;
+	save_snapshot( &snap );
+	
+	out.begin_block( vrc7_state_tag, vrc7_state_version );
+	out.write32( next_time );
+	out.write8( snap.latch );
+	out.write_bytes( snap.inst, sizeof snap.inst );
+	out.write_bytes( snap.regs, sizeof snap.regs );
+	out.write32( mono.last_amp );
+	for ( int i = 0; i < osc_count; i++ )
+		out.write32( oscs [i].last_amp );
+	
+	OPLL const* o = (OPLL const*) opll;
+	for ( int i = 0; i < opll_slot_count; i++ )
+	{
+		OPLL_SLOT const& slot = o->slot [i];
+		out.write32( slot.pg_phase );
+		out.write32( slot.output [0] );
+		out.write32( slot.output [1] );
+		out.write8( slot.eg_state );
+		out.write8( slot.key_flag );
+		out.write16( slot.eg_out );
+	}
+	out.write32( o->eg_counter );
+	out.write32( o->pm_phase );
+	out.write32( o->am_phase );
+	out.write8( o->lfo_am );
+	out.write32( o->noise );
+	out.end_block();
+}
+
+std::error_condition Nes_Vrc7_Apu::load_state( Nes_State_Reader& in )
+{
+	vrc7_snapshot_t snap;
+	int amps [1 + osc_count];
+	blip_time_t time = 0;
+	vrc7_opll_state_t fm;
+	int version = in.begin_block( vrc7_state_tag, vrc7_state_version );
+	if ( version )
+	{
+		time = in.read32();
+		snap.latch = in.read8();
+		in.read_bytes( snap.inst, sizeof snap.inst );
+		in.read_bytes( snap.regs, sizeof snap.regs );
+		for ( int i = 0; i < 1 + osc_count; i++ )
+			amps [i] = in.read32();
+		
+		for ( int i = 0; i < opll_slot_count; i++ )
+		{
+			fm.slots [i].phase      = in.read32();
+			fm.slots [i].output [0] = in.read32();
+			fm.slots [i].output [1] = in.read32();
+			fm.slots [i].eg_state   = in.read8();
+			fm.slots [i].key_flag   = in.read8();
+			fm.slots [i].eg_out     = in.read16();
+		}
+		fm.eg_counter = in.read32();
+		fm.pm_phase   = in.read32();
+		fm.am_phase   = in.read32();
+		fm.lfo_am     = in.read8();
+		fm.noise      = in.read32();
+		in.end_block();
+	}
+	
+	if ( in.error() )
+	{
+		reset();
+		return in.error();
+	}
+	
+	snap.delay = 0;
+	load_snapshot( snap );
+	next_time = time;
+	mono.last_amp = amps [0];
+	for ( int i = 0; i < osc_count; i++ )
+		oscs [i].last_amp = amps [i + 1];
+	
+	// Writing the registers keyed channels on from the start and gave every
+	// slot its patch, which makes emu2413 recompute the slot's rates from the
+	// envelope state restored here. Version 1 had no FM state, so it restarts.
+	if ( version >= 2 )
+	{
+		OPLL* o = (OPLL*) opll;
+		for ( int i = 0; i < opll_slot_count; i++ )
+		{
+			OPLL_SLOT& slot = o->slot [i];
+			slot.pg_phase   = fm.slots [i].phase;
+			slot.output [0] = fm.slots [i].output [0];
+			slot.output [1] = fm.slots [i].output [1];
+			slot.eg_state   = std::min( (int) fm.slots [i].eg_state, opll_eg_state_max );
+			slot.key_flag   = fm.slots [i].key_flag != 0;
+			slot.eg_out     = std::min( (int) fm.slots [i].eg_out, opll_eg_out_max );
+		}
+		o->eg_counter = fm.eg_counter;
+		o->pm_phase   = fm.pm_phase;
+		o->am_phase   = fm.am_phase;
+		o->lfo_am     = fm.lfo_am;
+		o->noise      = fm.noise;
+	}
+	return {};
+}
+
+// Renders a block of FM clocks into a scratch array, then adds the changes in
+// a separate pass, so the OPLL and Blip_Synth loops each stay in cache
 void Nes_Vrc7_Apu::run_until( blip_time_t end_time )
 {
 	assert( end_time > next_time );
 
+	OPLL* const opll = (OPLL*) this->opll;
 	blip_time_t time = next_time;
-	//Blip_Buffer* const mono_output = mono.output;
-	//int32_t buffer [2];
-	//e_int32* buffers[2] = {&buffer[0], &buffer[1]};
-	/*
-	if ( mono_output )
+	if ( mono.output )
 	{
-	*/
 		// optimal case
+		int16_t amps [block_size];
 		do
 		{
-			int amp = OPLL_calc((OPLL*)this->opll);
-			int delta = amp - mono.last_amp;
-			if (delta)
+			int count = std::min( (end_time - time + period - 1) / period, block_size );
+			for ( int n = 0; n < count; n++ )
+				amps [n] = OPLL_calc( opll );
+			
+			int last_amp = mono.last_amp;
+			for ( int n = 0; n < count; n++ )
 			{
-				mono.last_amp = amp;
-				synth.offset_inline( time, delta, mono.output );
+				int delta = amps [n] - last_amp;
+				if ( delta )
+				{
+					last_amp = amps [n];
+					synth.offset_inline( time, delta, mono.output );
+				}
+				time += period;
 			}
-			time += period;
+			mono.last_amp = last_amp;
 		}
 		while ( time < end_time );
-	/*
 	}
 	else
 	{
+		// OPLL_calc() leaves each channel's part of its result in ch_out, so
+		// one call gives all six. VRC7 has no channels 7-9 or rhythm, so the
+		// rest of ch_out is ignored.
 		mono.last_amp = 0;
+		int16_t amps [block_size] [osc_count];
 		do
 		{
-			OPLL_advance( (OPLL *) opll );
+			int count = std::min( (end_time - time + period - 1) / period, block_size );
+			for ( int n = 0; n < count; n++ )
+			{
+				OPLL_calc( opll );
+				memcpy( amps [n], opll->ch_out, sizeof amps [n] );
+			}
+			
 			for ( int i = 0; i < osc_count; ++i )
 			{
 				Vrc7_Osc& osc = oscs [i];
-				if ( osc.output )
+				if ( !osc.output )
+					continue;
+				
+				int last_amp = osc.last_amp;
+				blip_time_t t = time;
+				for ( int n = 0; n < count; n++ )
 				{
-					OPLL_calc_stereo( (OPLL *) opll, buffers, 1, i );
-					int amp = buffer [0] + buffer [1];
-					int delta = amp - osc.last_amp;
+					int delta = amps [n] [i] - last_amp;
 					if ( delta )
 					{
-						osc.last_amp = amp;
-						synth.offset( time, delta, osc.output );
+						last_amp = amps [n] [i];
+						synth.offset_inline( t, delta, osc.output );
 					}
+					t += period;
 				}
+				osc.last_amp = last_amp;
 			}
-			time += period;
+			time += count * period;
 		}
 		while ( time < end_time );
 	}
-	*/
 	next_time = time;
 }
@@ -16,14 +16,32 @@ public:
 	void treble_eq( blip_eq_t const& );
 	void set_output( Blip_Buffer* ) override;
 	enum { osc_count = 6 };
+	
+	// Channels with different outputs are rendered separately, which is slower
+	// than when all share one output
 	void set_output( int index, Blip_Buffer* );
 	void end_frame( blip_time_t ) override;
 	void save_snapshot( vrc7_snapshot_t* ) const;
 	void load_snapshot( vrc7_snapshot_t const& );
+	
+	// Saves/loads state in portable format (see Nes_State.h). Unlike a snapshot,
+	// this includes the FM synthesizer's phases, envelopes and LFO, so notes
+	// continue where they were. States saved before these were added still load,
+	// with notes restarting. Loading a bad state resets the chip and returns an
+	// error.
+	void save_state( Nes_State_Writer& ) const;
+	std::error_condition load_state( Nes_State_Reader& );
 
 	void write_reg( uint8_t reg );
 	void write_data( blip_time_t, uint8_t data );
 
+	// Writes to the register select at 0x9010 or data at 0x9030, in time order.
+	// Other addresses are ignored.
+	enum { reg_addr = 0x9010 };
+	enum { data_addr = 0x9030 };
+	enum { addr_mask = 0xF030 };
+	void write_registers( apu_write_t const [], size_t count );
+
 public:
 	Nes_Vrc7_Apu();
 	~Nes_Vrc7_Apu();
@@ -41,6 +41,7 @@ struct apu_reflection
 	{
 		REFLECT( state.delay,           osc.delay );
 		REFLECT( state.length,          osc.length_counter );
+		REFLECT( state.phase,           osc.phase );
 		REFLECT( state.linear_counter,  osc.linear_counter );
 		REFLECT( state.linear_mode,     osc.reg_written [3] );
 	}
@@ -60,13 +61,18 @@ struct apu_reflection
 		REFLECT( state.buf,             osc.buf );
 		REFLECT( state.bits_remain,     osc.bits_remain );
 		REFLECT( state.bits,            osc.bits );
-		REFLECT( state.buf_empty,       osc.buf_empty );
 		REFLECT( state.silence,         osc.silence );
 		REFLECT( state.irq_flag,        osc.irq_flag );
 		if ( mode )
-			state.addr = osc.address | 0x8000;
+		{
+			state.addr      = osc.address | 0x8000;
+			state.buf_empty = !osc.buf_full;
+		}
 		else
-			osc.address = state.addr & 0x7fff;
+		{
+			osc.address  = state.addr & 0x7fff;
+			osc.buf_full = !state.buf_empty;
+		}
 	}
 };
 
@@ -118,5 +124,6 @@ void Nes_Apu::load_snapshot( apu_snapshot_t const& state )
 	refl::reflect_dmc     ( st.dmc,         dmc );
 	dmc.recalc_irq();
 	dmc.last_amp = dmc.dac;
+	update_idle();
 }
 
@@ -4,6 +4,8 @@
 // Nes_Snd_Emu 0.1.7. Copyright (C) 2003-2005 Shay Green. GNU LGPL license.
 #pragma once
 
+#include <cstdint>
+
 struct apu_snapshot_t
 {
 	typedef uint8_t byte;
@@ -62,7 +64,7 @@ struct apu_snapshot_t
 		byte irq_flag;
 	} dmc;
 	
-	enum { tag = 'APUR' };
+	enum { tag = 0x41505552 }; // 'APUR'
 	void swap();
 };
 static_assert( sizeof (apu_snapshot_t) == 72, "apu_snapshot_t should be exactly 72 bytes");
@@ -27,13 +27,17 @@ static const char* sdl_error( const char* str )
 	return str;
 }
 
-Sound_Queue::Sound_Queue()
+Sound_Queue::Sound_Queue() :
+	write_count( 0 ),
+	read_count( 0 ),
+	underruns_( 0 ),
+	overruns_( 0 ),
+	writer_waiting( false )
 {
-	bufs = NULL;
+	buf = NULL;
+	buf_mask = 0;
+	capacity_ = 0;
 	free_sem = NULL;
-	write_buf = 0;
-	write_pos = 0;
-	read_buf = 0;
 	sound_open = false;
 }
 
@@ -48,24 +52,31 @@ Sound_Queue::~Sound_Queue()
 	if ( free_sem )
 		SDL_DestroySemaphore( free_sem );
 	
-	delete [] bufs;
+	delete [] buf;
 }
 
 int Sound_Queue::sample_count() const
 {
-	int buf_free = SDL_SemValue( free_sem ) * buf_size + (buf_size - write_pos);
-	return buf_size * buf_count - buf_free;
+	return (int) (write_count.load( std::memory_order_acquire ) -
+			read_count.load( std::memory_order_acquire ));
 }
 
-const char* Sound_Queue::init( long sample_rate, int chan_count )
+const char* Sound_Queue::init( long sample_rate, int chan_count, int capacity, int device_samples )
 {
-	assert( !bufs ); // can only be initialized once
+	assert( !buf ); // can only be initialized once
+	assert( capacity > 0 && device_samples > 0 );
 	
-	bufs = new sample_t [(long) buf_size * buf_count];
-	if ( !bufs )
+	unsigned size = 1;
+	while ( size < (unsigned) capacity )
+		size *= 2;
+	
+	buf = new sample_t [size];
+	if ( !buf )
 		return "Out of memory";
+	buf_mask = size - 1;
+	capacity_ = capacity;
 	
-	free_sem = SDL_CreateSemaphore( buf_count - 1 );
+	free_sem = SDL_CreateSemaphore( 0 );
 	if ( !free_sem )
 		return sdl_error( "Couldn't create semaphore" );
 	
@@ -74,7 +85,7 @@ const char* Sound_Queue::init( long sample_rate, int chan_count )
 	as.format = AUDIO_S16SYS;
 	as.channels = chan_count;
 	as.silence = 0;
-	as.samples = buf_size;
+	as.samples = device_samples;
 	as.size = 0;
 	as.callback = fill_buffer_;
 	as.userdata = this;
@@ -86,45 +97,75 @@ const char* Sound_Queue::init( long sample_rate, int chan_count )
 	return NULL;
 }
 
-inline Sound_Queue::sample_t* Sound_Queue::buf( int index )
+int Sound_Queue::write_( const sample_t* in, int count )
+{
+	unsigned pos = write_count.load( std::memory_order_relaxed );
+	unsigned used = pos - read_count.load( std::memory_order_acquire );
+	int n = (int) (capacity_ - used);
+	if ( n > count )
+		n = count;
+	
+	// copy in up to two pieces, around the end of buf
+	int first = (int) (buf_mask + 1 - (pos & buf_mask));
+	if ( first > n )
+		first = n;
+	memcpy( buf + (pos & buf_mask), in, first * sizeof (sample_t) );
+	memcpy( buf, in + first, (n - first) * sizeof (sample_t) );
+	write_count.store( pos + n, std::memory_order_release );
+	return n;
+}
+
+int Sound_Queue::try_write( const sample_t* in, int count )
 {
-	assert( (unsigned) index < buf_count );
-	return bufs + (long) index * buf_size;
+	int n = write_( in, count );
+	if ( n < count )
+		overruns_.fetch_add( count - n, std::memory_order_relaxed );
+	return n;
 }
 
 void Sound_Queue::write( const sample_t* in, int count )
 {
-	while ( count )
+	while ( true )
 	{
-		int n = buf_size - write_pos;
-		if ( n > count )
-			n = count;
-		
-		memcpy( buf( write_buf ) + write_pos, in, n * sizeof (sample_t) );
+		int n = write_( in, count );
 		in += n;
-		write_pos += n;
 		count -= n;
+		if ( !count )
+			break;
 		
-		if ( write_pos >= buf_size )
-		{
-			write_pos = 0;
-			write_buf = (write_buf + 1) % buf_count;
+		// Wait for callback to free space. Flag is set before checking again,
+		// so either the check sees the space or the callback sees the flag.
+		writer_waiting.store( true );
+		if ( write_count.load( std::memory_order_relaxed ) - read_count.load() >= capacity_ )
 			SDL_SemWait( free_sem );
-		}
+		writer_waiting.store( false );
 	}
 }
 
-void Sound_Queue::fill_buffer( Uint8* out, int count )
+void Sound_Queue::fill_buffer( Uint8* out_, int size )
 {
-	if ( SDL_SemValue( free_sem ) < buf_count - 1 )
-	{
-		memcpy( out, buf( read_buf ), count );
-		read_buf = (read_buf + 1) % buf_count;
+	sample_t* out = (sample_t*) out_;
+	int count = size / (int) sizeof (sample_t);
+	
+	unsigned pos = read_count.load( std::memory_order_relaxed );
+	unsigned avail = write_count.load( std::memory_order_acquire ) - pos;
+	int n = count;
+	if ( (unsigned) n > avail )
+		n = (int) avail;
+	
+	int first = (int) (buf_mask + 1 - (pos & buf_mask));
+	if ( first > n )
+		first = n;
+	memcpy( out, buf + (pos & buf_mask), first * sizeof (sample_t) );
+	memcpy( out + first, buf, (n - first) * sizeof (sample_t) );
+	read_count.store( pos + n );
+	if ( n && writer_waiting.exchange( false ) )
 		SDL_SemPost( free_sem );
-	}
-	else
+	
+	if ( n < count )
 	{
-		memset( out, 0, count );
+		memset( out + n, 0, (count - n) * sizeof (sample_t) );
+		underruns_.fetch_add( count - n, std::memory_order_relaxed );
 	}
 }
 
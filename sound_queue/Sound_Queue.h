@@ -7,34 +7,61 @@
 
 #include "SDL.h"
 
-// Simple SDL sound wrapper that has a synchronous interface
+#include <atomic>
+
+// Simple SDL sound wrapper that has a synchronous interface. Samples go through
+// a lock-free ring shared with the audio callback, which never waits. Only a
+// write() to a full queue blocks, on a semaphore the callback signals when it
+// frees space, so it doesn't poll.
 class Sound_Queue {
 public:
 	Sound_Queue();
 	~Sound_Queue();
-	
-	// Initialize with specified sample rate and channel count.
+
+	// Initialize with specified sample rate and channel count. The queue holds
+	// up to capacity samples, and the audio device is asked for
+	// device_samples sample frames per callback. Together these set the latency.
 	// Returns NULL on success, otherwise error string.
-	const char* init( long sample_rate, int chan_count = 1 );
-	
+	enum { default_capacity = 3 * 2048 };
+	enum { default_device_samples = 2048 };
+	const char* init( long sample_rate, int chan_count = 1, int capacity = default_capacity,
+			int device_samples = default_device_samples );
+
 	// Number of samples in buffer waiting to be played
 	int sample_count() const;
-	
+
+	// Number of samples the queue can hold, as passed to init()
+	int capacity() const { return (int) capacity_; }
+
 	// Write samples to buffer and block until enough space is available
 	typedef short sample_t;
 	void write( const sample_t*, int count );
-	
+
+	// Write as many samples as there is space for without blocking, and return
+	// number written. Any that don't fit are counted as overruns.
+	int try_write( const sample_t*, int count );
+
+	// Number of samples of silence played because the queue ran dry, and number
+	// dropped by try_write() because it was full
+	long underruns() const { return underruns_; }
+	long overruns() const { return overruns_; }
+
 private:
-	enum { buf_size = 2048 };
-	enum { buf_count = 3 };
-	sample_t* volatile bufs;
-	SDL_sem* volatile free_sem;
-	int volatile read_buf;
-	int write_buf;
-	int write_pos;
+	sample_t* buf;
+	unsigned buf_mask; // size is a power of two, for masking only
+	unsigned capacity_; // no more than this many samples are queued
+
+	// Total samples written and read; only the writer stores write_count and
+	// only the audio callback stores read_count
+	std::atomic<unsigned> write_count;
+	std::atomic<unsigned> read_count;
+	std::atomic<long> underruns_;
+	std::atomic<long> overruns_;
+	std::atomic<bool> writer_waiting; // write() is waiting for free_sem
+	SDL_sem* free_sem;
 	bool sound_open;
-	
-	sample_t* buf( int index );
+
+	int write_( const sample_t*, int count );
 	void fill_buffer( Uint8*, int );
 	static void fill_buffer_( void*, Uint8*, int );
 };